@@ -6,21 +6,46 @@
  * Copyright (C) 2019-2020 Raspberry Pi (Trading) Ltd
  */
 #include <asm/unaligned.h>
+#include <linux/atomic.h>
 #include <linux/clk.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/gpio/consumer.h>
+#include <linux/hrtimer.h>
 #include <linux/i2c.h>
+#include <linux/iio/consumer.h>
+#include <linux/interrupt.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/of_device.h>
 #include <linux/pm_runtime.h>
+#include <linux/property.h>
 #include <linux/regulator/consumer.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <media/mipi-csi2.h>
 #include <media/v4l2-ctrls.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-event.h>
 #include <media/v4l2-fwnode.h>
 #include <media/v4l2-mediabus.h>
 
+static bool lazy_identify;
+module_param(lazy_identify, bool, 0444);
+MODULE_PARM_DESC(lazy_identify,
+		 "Check the chip ID on first use instead of at probe");
+
 /* Chip ID */
+/*
+ * No ID register is documented. 0x30DC is the low byte of BLKLEVEL, which
+ * reads back its reset value of 0x32 after a reset. That only holds when a
+ * reset GPIO has pulsed XCLR or the VANA supply was off before power up,
+ * otherwise the register keeps whatever was last written and only the bus
+ * access is checked.
+ */
 #define IMX585_REG_CHIP_ID		0x30DC
 #define IMX585_CHIP_ID			0x32
 
@@ -28,6 +53,25 @@
 #define IMX585_MODE_STANDBY		0x01
 #define IMX585_MODE_STREAMING		0x00
 
+/* Register hold: latch grouped writes at the same frame boundary */
+#define IMX585_REG_REGHOLD		0x3001
+
+/* Master mode operation start/stop */
+#define IMX585_REG_XMSTA		0x3002
+#define IMX585_XMSTA_START		0x00
+#define IMX585_XMSTA_STOP		0x01
+
+/* XVS/XHS pin drive: output on the master, Hi-Z on a slave */
+#define IMX585_REG_XXS_DRV		0x30A6
+#define IMX585_XXS_DRV_OUTPUT		0x00
+#define IMX585_XXS_DRV_HIZ		0x0F
+
+/* CSI-2 lane rate, indexed like link_freq_menu_items */
+#define IMX585_REG_DATARATE_SEL		0x3015
+
+/* Wait after cancelling standby before starting master operation */
+#define IMX585_STANDBY_EXIT_DELAY_US	80000
+
 #define IMX585_XCLK_FREQ		24000000
 
 /* VMAX internal VBLANK*/
@@ -55,11 +99,201 @@
 #define IMX585_ANA_GAIN_STEP		1
 #define IMX585_ANA_GAIN_DEFAULT		0x0
 
+/*
+ * Digital gain control, in the same 0.3 dB steps as GAIN. The sensor has a
+ * single GAIN register spanning 0 to 72 dB, with everything above 30 dB
+ * applied digitally, so the digital gain is added to the analogue gain code.
+ * ANALOGUE_GAIN keeps the whole register range for existing users, and the
+ * digital gain is clamped so the sum stays within IMX585_ANA_GAIN_MAX.
+ */
+#define IMX585_DGTL_GAIN_MIN		0
+#define IMX585_DGTL_GAIN_MAX		140
+#define IMX585_DGTL_GAIN_STEP		1
+#define IMX585_DGTL_GAIN_DEFAULT	0
+
+/* Black level offset, 10 bits */
+#define IMX585_REG_BLKLEVEL		0x30DC
+#define IMX585_BLKLEVEL_MIN		0
+#define IMX585_BLKLEVEL_MAX		0x3FF
+#define IMX585_BLKLEVEL_STEP		1
+#define IMX585_BLKLEVEL_DEFAULT		0x32
+
+/* Flash pulse length limit in us */
+#define IMX585_FLASH_TIMEOUT_MIN	1
+#define IMX585_FLASH_TIMEOUT_MAX	1000000
+#define IMX585_FLASH_TIMEOUT_STEP	1
+
+#define IMX585_REG_HFLIP		0x3020
 #define IMX585_REG_VFLIP		0x3021
 
-/* Embedded metadata stream structure */
-#define IMX585_EMBEDDED_LINE_WIDTH 16384
-#define IMX585_NUM_EMBEDDED_LINES 1
+/*
+ * Sensor temperature in millidegrees Celsius from an IIO channel, read at
+ * most once per interval and cached in between.
+ */
+#define IMX585_TEMP_MIN			-40000
+#define IMX585_TEMP_MAX			125000
+#define IMX585_TEMP_INTERVAL_NS		(1000 * NSEC_PER_MSEC)
+
+/*
+ * Thermal governor: while streaming above the limit, VBLANK is stepped up
+ * once per interval, and stepped back down once the temperature has
+ * dropped by the hysteresis.
+ */
+#define IMX585_THERMAL_INTERVAL_MS	1000
+#define IMX585_THERMAL_HYSTERESIS	2000
+#define IMX585_THERMAL_VBLANK_STEP	256
+
+/*
+ * Timelapse: stream IMX585_TIMELAPSE_FRAMES frames per capture, counted at
+ * frame start, and enter standby once the last one is read out. Then sit in
+ * standby until the standby exit delay before the next one is due.
+ */
+#define IMX585_TIMELAPSE_MIN_MS		0
+#define IMX585_TIMELAPSE_MAX_MS		86400000
+#define IMX585_TIMELAPSE_FRAMES		2
+
+/* Longest run of consecutive registers sent in one I2C write */
+#define IMX585_BURST_MAX		32
+
+/* Bytes saved at suspend, the sum of imx585_snapshot_windows lengths */
+#define IMX585_SNAPSHOT_SIZE		22
+
+/*
+ * Stream start phases timed for debugfs, the last samples of each kept.
+ * RESUME covers a whole system resume back to streaming.
+ */
+enum imx585_phase {
+	IMX585_PHASE_POWER_ON,
+	IMX585_PHASE_COMMON_REGS,
+	IMX585_PHASE_MODE_REGS,
+	IMX585_PHASE_CTRL_SETUP,
+	IMX585_PHASE_STANDBY_EXIT,
+	IMX585_PHASE_RESUME,
+	IMX585_NUM_PHASES,
+};
+
+#define IMX585_PHASE_SAMPLES		32
+
+/*
+ * Per-frame control queue: userspace queues (exposure, gain, vblank)
+ * triplets that are applied one per frame from the frame start trigger.
+ */
+#define IMX585_FRAME_QUEUE_DEPTH	16
+#define IMX585_FRAME_CTRLS_FIELDS	3
+
+/* Driver specific controls */
+#define V4L2_CID_IMX585_BASE		(V4L2_CID_USER_BASE + 0x2000)
+#define V4L2_CID_IMX585_FRAME_QUEUE	(V4L2_CID_IMX585_BASE + 0)
+#define V4L2_CID_IMX585_EXPOSURE_DELAY	(V4L2_CID_IMX585_BASE + 1)
+#define V4L2_CID_IMX585_GAIN_DELAY	(V4L2_CID_IMX585_BASE + 2)
+#define V4L2_CID_IMX585_VBLANK_DELAY	(V4L2_CID_IMX585_BASE + 3)
+#define V4L2_CID_IMX585_BLACK_LEVEL	(V4L2_CID_IMX585_BASE + 4)
+#define V4L2_CID_IMX585_SYNC_MODE	(V4L2_CID_IMX585_BASE + 5)
+#define V4L2_CID_IMX585_FRAME_TIMING	(V4L2_CID_IMX585_BASE + 6)
+#define V4L2_CID_IMX585_FRAME_STATS	(V4L2_CID_IMX585_BASE + 7)
+#define V4L2_CID_IMX585_TEMPERATURE	(V4L2_CID_IMX585_BASE + 8)
+#define V4L2_CID_IMX585_THERMAL_LIMIT	(V4L2_CID_IMX585_BASE + 9)
+#define V4L2_CID_IMX585_TIMELAPSE	(V4L2_CID_IMX585_BASE + 10)
+#define V4L2_CID_IMX585_POWER_PROFILE	(V4L2_CID_IMX585_BASE + 11)
+
+/*
+ * Layout of the frame timing control, all times are CLOCK_MONOTONIC ns for
+ * the frame whose readout started at the last frame start. Exposure times
+ * are those of the first line, later lines are offset by one line period
+ * each (rolling shutter).
+ */
+enum imx585_frame_timing {
+	IMX585_TIMING_SEQUENCE,
+	IMX585_TIMING_FRAME_START,
+	IMX585_TIMING_EXPOSURE_START,
+	IMX585_TIMING_EXPOSURE_END,
+	IMX585_TIMING_FIELDS,
+};
+
+/*
+ * Per-stream counters of the frame stats control, reset at stream on.
+ * FRAMES counts sensor frame starts; comparing it with the sequence of
+ * delivered buffers tells receiver drops apart from sensor side ones.
+ * MISSED_FRAMES counts XVS edges inferred from gaps between interrupts,
+ * LATE_UPDATES queued controls applied after the next frame had started
+ * and QUEUE_OVERFLOWS frame queue writes rejected as full.
+ */
+enum imx585_frame_stats {
+	IMX585_STATS_FRAMES,
+	IMX585_STATS_MISSED_FRAMES,
+	IMX585_STATS_LATE_UPDATES,
+	IMX585_STATS_QUEUE_OVERFLOWS,
+	IMX585_STATS_FIELDS,
+};
+
+/*
+ * Multi-camera sync role. A master generates XVS/XHS and drives them out, a
+ * slave leaves the pins Hi-Z and follows the sync pulses it receives. The
+ * XMASTER pin strapping on the module must match.
+ *
+ * External trigger is slave operation paced by a trigger source (e.g. a
+ * photo-eye) on XVS: each pulse ends the running exposure and reads out one
+ * frame, so frames only come when triggered. The host must still supply a
+ * continuous XHS at the mode's HMAX. The frame length is pinned to the mode
+ * minimum, which is also the shortest allowed pulse interval.
+ *
+ * Integration runs from SHR after one XVS pulse to the next one, so with
+ * aperiodic pulses the exposure follows the pulse spacing minus SHR lines,
+ * not V4L2_CID_EXPOSURE. The exposure control only sets SHR, and its limit
+ * of one minimum frame does not bound the real exposure.
+ */
+enum imx585_sync_mode {
+	IMX585_SYNC_MASTER,
+	IMX585_SYNC_SLAVE,
+	IMX585_SYNC_TRIGGER,
+};
+
+/*
+ * Control application delays in frames. SHR, GAIN and VMAX are double
+ * buffered: a value written (or released from REGHOLD) during frame N is
+ * latched at the start of frame N+1, and frame N+1 is the first one read
+ * out with it, which userspace sees as a delay of two frames.
+ */
+#define IMX585_EXPOSURE_DELAY		2
+#define IMX585_GAIN_DELAY		2
+#define IMX585_VBLANK_DELAY		2
+
+/* Image bit depth, all modes are RAW12 */
+#define IMX585_BPP			12
+
+/*
+ * Embedded metadata stream structure
+ *
+ * The IMX585 produces no embedded data with this driver. Its embedded data
+ * enable is not documented, nothing here sets it, and the sensor has not
+ * been seen to send a DT 0x12 line at its power on default. The metadata
+ * pad is kept for the pipeline's sake but carries no data, and
+ * get_frame_desc() does not list it.
+ *
+ * The layout below is what other Sony sensors send and is unverified on
+ * the IMX585. It is kept for the day the enable is found, as the basis of
+ * libimx585md and the per-mode geometry.
+ *
+ * Sony sensors send register state ahead of the image as CSI-2 embedded
+ * data (data type 0x12), one line packed at the image bit depth. Every
+ * third byte of a RAW12 line holds the low bits of the two bytes before
+ * it and carries no metadata, so 2 of every 3 bytes are payload. The
+ * payload starts with the format code 0x0A followed by tagged bytes:
+ *
+ *   0xAA  register address [15:8]
+ *   0xA5  register address [7:0]
+ *   0x5A  register value, the address then increments
+ *   0x55  register skipped, the address increments
+ *   0x07  end of data, the rest of the line is padding
+ *
+ * The line is as long as an image line in bytes, so its width in
+ * MEDIA_BUS_FMT_SENSOR_DATA bytes follows from the mode width and bit
+ * depth, see struct imx585_mode.
+ */
+#define IMX585_EMBEDDED_BPP		IMX585_BPP
+#define IMX585_NUM_EMBEDDED_LINES	1
+#define IMX585_EMBEDDED_LINE_WIDTH(width) \
+	((width) * IMX585_EMBEDDED_BPP / 8)
 
 enum pad_types {
 	IMAGE_PAD,
@@ -78,8 +312,34 @@ enum pad_types {
 
 
 
+/*
+ * Link frequencies, fastest first, with the DATARATE_SEL value for each.
+ * Mode timings are for the first; slower rates need proportionally
+ * longer lines, see imx585_min_hmax().
+ */
 static const s64 link_freq_menu_items[] = {
-    891000000, // 720 MHz
+    891000000, // 1782 Mbps
+    720000000, // 1440 Mbps
+    594000000, // 1188 Mbps
+    445500000, // 891 Mbps
+};
+
+static const u8 imx585_datarate_sel[] = {
+    0x02,
+    0x03,
+    0x04,
+    0x05,
+};
+
+/*
+ * Power profiles pick the link frequency. Performance uses the fastest
+ * rate and Balanced the next one. Low Power takes the slowest rate whose
+ * line time still fits the current frame interval, and keeps that interval.
+ */
+enum imx585_power_profile {
+	IMX585_PROFILE_PERFORMANCE,
+	IMX585_PROFILE_BALANCED,
+	IMX585_PROFILE_LOW_POWER,
 };
 
 
@@ -119,6 +379,10 @@ struct imx585_mode {
 	/* Analog crop rectangle. */
 	struct v4l2_rect crop;
 
+	/* Embedded data line length in bytes and number of lines */
+	unsigned int embedded_width;
+	unsigned int embedded_lines;
+
 	/* Default register values */
 	struct IMX585_reg_list reg_list;
 };
@@ -140,7 +404,6 @@ static const struct imx585_reg mode_common_regs[] = {
     {0x3050, 0xFF},// SHR0 [19:0]
     {0x3051, 0x00},// SHR0 [19:0]
     {0x3052, 0x00},// SHR0 [19:0]
-    {0x30A6, 0x00},// XVS_DRV [1:0]
 
     //Normal
     
@@ -393,10 +656,6 @@ static const struct imx585_reg mode_common_regs[] = {
     {0x5222, 0x91},// -
     {0x5224, 0x87},// -
     {0x5226, 0x82},// -
-    {0x3000, 0x00}, //standby Cancel
-
-    {0xFFFE, 0x50},
-    {0x3002, 0x00},
 };
 
 /* 20MPix 20fps readout mode 0 */
@@ -422,6 +681,8 @@ static const struct imx585_mode supported_modes_12bit[] = {
 			.width = imx585_PIXEL_ARRAY_WIDTH,
 			.height = imx585_PIXEL_ARRAY_HEIGHT,
 		},
+		.embedded_width = IMX585_EMBEDDED_LINE_WIDTH(IMX585_NATIVE_WIDTH),
+		.embedded_lines = IMX585_NUM_EMBEDDED_LINES,
 		.reg_list = {
 			.num_of_regs = ARRAY_SIZE(mode_4k_regs),
 			.regs = mode_4k_regs,
@@ -470,11 +731,24 @@ static const char * const imx585_supply_name[] = {
 #define imx585_XCLR_MIN_DELAY_US	500000
 #define imx585_XCLR_DELAY_RANGE_US	1000
 
+/* Idle time before a staged or stopped sensor is powered down */
+#define IMX585_AUTOSUSPEND_DELAY_MS	2000
+
 struct imx585_compatible_data {
 	unsigned int chip_id;
+	/* Mono variant, no colour filter array */
+	bool mono;
+	const char *name;
 	struct IMX585_reg_list extra_regs;
 };
 
+/* One entry of the per-frame control queue */
+struct imx585_frame_ctrls {
+	u32 exposure;
+	u32 gain;
+	u32 vblank;
+};
+
 struct imx585 {
 	struct v4l2_subdev sd;
 	struct media_pad pad[NUM_PADS];
@@ -485,21 +759,65 @@ struct imx585 {
 	u32 xclk_freq;
 
 	struct gpio_desc *reset_gpio;
+
+	/* Optional XVS input, its falling edge marks each frame start */
+	struct gpio_desc *xvs_gpio;
+	int xvs_irq;
+	bool xvs_irq_enabled;
+	u64 xvs_timestamp;
+	atomic_t frame_sequence;
+
+	/*
+	 * Exposure last written to SHR, and the one latched at the previous
+	 * frame start, which is what the frame being read out integrated.
+	 */
+	u32 exposure_lines;
+	u64 latched_exposure_ns;
+
+	/* Timing of the last frame and frame stats, protected by timing_lock */
+	spinlock_t timing_lock;
+	s64 timing[IMX585_TIMING_FIELDS];
+	u32 stats[IMX585_STATS_FIELDS];
+	/* Next frame start follows a standby gap, not a missed edge */
+	bool timing_resync;
+
+	/* Frame whose start queued frame_work */
+	u32 frame_work_sequence;
+
+	/*
+	 * Optional flash/strobe output. flash_timer raises it at the start of
+	 * the next frame's exposure and drops it at flash_end.
+	 */
+	struct gpio_desc *flash_gpio;
+	struct hrtimer flash_timer;
+	u64 flash_end;
 	struct regulator_bulk_data supplies[imx585_NUM_SUPPLIES];
 
 	struct v4l2_ctrl_handler ctrl_handler;
 	/* V4L2 Controls */
 	struct v4l2_ctrl *pixel_rate;
 	struct v4l2_ctrl *link_freq;
-	struct v4l2_ctrl *exposure;
 	struct v4l2_ctrl *vflip;
 	struct v4l2_ctrl *hflip;
-	struct v4l2_ctrl *vblank;
 	struct v4l2_ctrl *hblank;
+	struct v4l2_ctrl *sync_mode;
+	struct v4l2_ctrl *power_profile;
+	struct v4l2_ctrl *flash_mode;
+	struct v4l2_ctrl *flash_timeout;
+	struct {
+		/* Exposure cluster, VBLANK is the master */
+		struct v4l2_ctrl *vblank;
+		struct v4l2_ctrl *exposure;
+		struct v4l2_ctrl *gain;
+		struct v4l2_ctrl *digital_gain;
+	};
 
 	/* Current mode */
 	const struct imx585_mode *mode;
 
+	/* Index into link_freq_menu_items picked by the power profile */
+	unsigned int data_rate;
+
 	uint16_t HMAX;
 	uint32_t VMAX;
 	/*
@@ -511,9 +829,83 @@ struct imx585 {
 	/* Streaming on/off */
 	bool streaming;
 
+	/* Controls are being replayed by __v4l2_ctrl_handler_setup() */
+	bool ctrl_setup;
+
+	/*
+	 * Per-frame control queue, protected by the mutex. frame_timer
+	 * estimates the frame start from VMAX x HMAX and kicks frame_work,
+	 * which applies one queued entry inside a register hold.
+	 */
+	DECLARE_KFIFO(frame_queue, struct imx585_frame_ctrls,
+		      IMX585_FRAME_QUEUE_DEPTH);
+	struct hrtimer frame_timer;
+	struct work_struct frame_work;
+
 	/* Rewrite common registers on stream on? */
 	bool common_regs_written;
 
+	/* Chip ID checked, at probe or on first power up */
+	bool identified;
+	/* Registers at their reset values, after a cold start or XCLR pulse */
+	bool regs_at_reset;
+
+	/*
+	 * Bring-up staged from set_fmt on an unbound workqueue, so that
+	 * several sensors power up and load their common registers in
+	 * parallel. The sensor then stays powered for the runtime PM
+	 * autosuspend delay. staged is set once the mode and controls are
+	 * programmed as well, leaving stream on to only exit standby. A
+	 * control change that cannot be written, once the staged reference
+	 * is dropped, clears it so stream on replays the handler.
+	 */
+	struct work_struct stage_work;
+	bool staged;
+
+	/*
+	 * Optional temperature channel of a sensor on the module, the on-die
+	 * thermometer is not documented. Cache protected by the mutex.
+	 */
+	struct iio_channel *temp_chan;
+	int temperature;
+	u64 temp_time_ns;
+
+	/*
+	 * Thermal governor, protected by the mutex. thermal_vblank is the
+	 * VBLANK it started throttling from, or the user last set, and
+	 * returns to. thermal_update marks its own VBLANK writes.
+	 */
+	struct v4l2_ctrl *thermal_limit;
+	struct delayed_work thermal_work;
+	bool thermal_throttled;
+	bool thermal_update;
+	s32 thermal_vblank;
+
+	/*
+	 * Timelapse, protected by the mutex. timelapse_next is the
+	 * CLOCK_MONOTONIC time of the current or next capture.
+	 */
+	struct v4l2_ctrl *timelapse;
+	struct delayed_work timelapse_work;
+	bool timelapse_standby;
+	u64 timelapse_next;
+	/*
+	 * Frame starts of the current capture and the end of the last
+	 * frame's readout, protected by timing_lock
+	 */
+	bool timelapse_counting;
+	unsigned int timelapse_frames;
+	u64 timelapse_readout_end;
+
+	/* Control registers read back at system suspend */
+	u8 snapshot[IMX585_SNAPSHOT_SIZE];
+	bool snapshot_valid;
+
+	/* Stream start phase durations in us, protected by the mutex */
+	u32 phase_us[IMX585_NUM_PHASES][IMX585_PHASE_SAMPLES];
+	unsigned int phase_count[IMX585_NUM_PHASES];
+	struct dentry *debugfs;
+
 	/* Any extra information related to different compatible sensors */
 	const struct imx585_compatible_data *compatible_data;
 };
@@ -533,6 +925,7 @@ static inline void get_mode_table(unsigned int code,
 	case MEDIA_BUS_FMT_SGRBG12_1X12:
 	case MEDIA_BUS_FMT_SGBRG12_1X12:
 	case MEDIA_BUS_FMT_SBGGR12_1X12:
+	case MEDIA_BUS_FMT_Y12_1X12:
 		*mode_list = supported_modes_12bit;
 		*num_modes = ARRAY_SIZE(supported_modes_12bit);
 		break;
@@ -620,27 +1013,81 @@ static int imx585_write_reg_3byte(struct imx585 *imx585, u16 reg, u32 val)
 	return 0;
 }
 
-/* Write a list of 1 byte registers */
+/* Write len consecutive registers starting at reg in one transfer */
+static int imx585_write_burst(struct imx585 *imx585, u16 reg,
+			      const u8 *vals, unsigned int len)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
+	u8 buf[2 + IMX585_BURST_MAX];
+
+	if (len > IMX585_BURST_MAX)
+		return -EINVAL;
+
+	put_unaligned_be16(reg, buf);
+	memcpy(&buf[2], vals, len);
+	if (i2c_master_send(client, buf, len + 2) != len + 2)
+		return -EIO;
+
+	return 0;
+}
+
+/* Read len consecutive registers starting at reg in one transfer */
+static int imx585_read_burst(struct imx585 *imx585, u16 reg, u8 *vals,
+			     unsigned int len)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
+	u8 addr_buf[2] = { reg >> 8, reg & 0xff };
+	struct i2c_msg msgs[2] = {
+		{
+			.addr = client->addr,
+			.flags = 0,
+			.len = ARRAY_SIZE(addr_buf),
+			.buf = addr_buf,
+		}, {
+			.addr = client->addr,
+			.flags = I2C_M_RD,
+			.len = len,
+			.buf = vals,
+		},
+	};
+
+	if (i2c_transfer(client->adapter, msgs, ARRAY_SIZE(msgs)) !=
+	    ARRAY_SIZE(msgs))
+		return -EIO;
+
+	return 0;
+}
+
+/*
+ * Write a list of 1 byte registers. Runs of consecutive addresses are
+ * coalesced into burst writes, 0xFFFE entries are delays in ms.
+ */
 static int imx585_write_regs(struct imx585 *imx585,
 			     const struct imx585_reg *regs, u32 len)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
-	unsigned int i;
+	u8 vals[IMX585_BURST_MAX];
+	unsigned int i, n;
 	int ret;
 
-	for (i = 0; i < len; i++) {
+	for (i = 0; i < len; i += n) {
 		if (regs[i].address == 0xFFFE) {
 			usleep_range(regs[i].val*1000,(regs[i].val+1)*1000);
+			n = 1;
+			continue;
 		}
-		else{
-			ret = imx585_write_reg_1byte(imx585, regs[i].address, regs[i].val);
-			if (ret) {
-				dev_err_ratelimited(&client->dev,
-						    "Failed to write reg 0x%4.4x. error = %d\n",
-						    regs[i].address, ret);
-
-				return ret;
-			}
+
+		for (n = 0; n < IMX585_BURST_MAX && i + n < len &&
+		     regs[i + n].address == regs[i].address + n; n++)
+			vals[n] = regs[i + n].val;
+
+		ret = imx585_write_burst(imx585, regs[i].address, vals, n);
+		if (ret) {
+			dev_err_ratelimited(&client->dev,
+					    "Failed to write reg 0x%4.4x. error = %d\n",
+					    regs[i].address, ret);
+
+			return ret;
 		}
 	}
 
@@ -652,10 +1099,21 @@ static u32 imx585_get_format_code(struct imx585 *imx585, u32 code)
 {
 	unsigned int i;
 	lockdep_assert_held(&imx585->mutex);
+
+	/* Flips do not change anything without a colour filter */
+	if (imx585->compatible_data->mono)
+		return MEDIA_BUS_FMT_Y12_1X12;
+
 	for (i = 0; i < ARRAY_SIZE(codes); i++)
 		if (codes[i] == code)
 			break;
 
+	if (i >= ARRAY_SIZE(codes))
+		i = 0;
+
+	i = (i & ~3) | (imx585->vflip->val ? 2 : 0) |
+	    (imx585->hflip->val ? 1 : 0);
+
 	return codes[i];
 }
 
@@ -685,8 +1143,8 @@ static int imx585_open(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
 	try_fmt_img->field = V4L2_FIELD_NONE;
 
 	/* Initialize try_fmt for the embedded metadata pad */
-	try_fmt_meta->width = IMX585_EMBEDDED_LINE_WIDTH;
-	try_fmt_meta->height = IMX585_NUM_EMBEDDED_LINES;
+	try_fmt_meta->width = supported_modes_12bit[0].embedded_width;
+	try_fmt_meta->height = supported_modes_12bit[0].embedded_lines;
 	try_fmt_meta->code = MEDIA_BUS_FMT_SENSOR_DATA;
 	try_fmt_meta->field = V4L2_FIELD_NONE;
 
@@ -739,6 +1197,242 @@ static uint32_t calculate_shr(uint32_t exposure, uint32_t hmax, uint64_t vmax, u
     return shr;
 }
 
+/* VBLANK limits, a trigger paced frame always runs at the minimum VMAX */
+static void imx585_update_vblank_range(struct imx585 *imx585)
+{
+	const struct imx585_mode *mode = imx585->mode;
+	u64 min_vblank = mode->min_VMAX - mode->height;
+	u64 max_vblank = IMX585_VMAX_MAX - mode->height;
+	u64 def_vblank = mode->default_VMAX - mode->height;
+
+	if (imx585->sync_mode->val == IMX585_SYNC_TRIGGER)
+		max_vblank = def_vblank = min_vblank;
+
+	__v4l2_ctrl_modify_range(imx585->vblank, min_vblank, max_vblank, 1,
+				 def_vblank);
+}
+
+/* GAIN register code for an analogue gain plus the digital gain control */
+static u32 imx585_gain_code(struct imx585 *imx585, u32 analogue_gain)
+{
+	return min_t(u32, analogue_gain + imx585->digital_gain->val,
+		     IMX585_ANA_GAIN_MAX);
+}
+
+/*
+ * Write VMAX, SHR and gain inside one register hold so the sensor latches
+ * them together at the next frame boundary.
+ */
+static int imx585_write_exposure_regs(struct imx585 *imx585, u32 exposure,
+				      u32 gain)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
+	uint32_t shr;
+	int ret, err;
+
+	shr = calculate_shr(exposure, imx585->HMAX, imx585->VMAX, 0, 0);
+	WRITE_ONCE(imx585->exposure_lines, exposure);
+
+	dev_dbg(&client->dev, "VMAX:%u, SHR:%u, gain:%u\n",
+		imx585->VMAX, shr, gain);
+
+	ret = imx585_write_reg_1byte(imx585, IMX585_REG_REGHOLD, 0x01);
+	if (ret)
+		return ret;
+
+	ret = imx585_write_reg_3byte(imx585, IMX585_REG_VMAX, imx585->VMAX);
+	if (!ret)
+		ret = imx585_write_reg_3byte(imx585, IMX585_REG_SHR, shr);
+	if (!ret)
+		ret = imx585_write_reg_2byte(imx585, IMX585_REG_ANALOG_GAIN,
+					     gain);
+
+	/* Release the hold even if one of the writes failed */
+	err = imx585_write_reg_1byte(imx585, IMX585_REG_REGHOLD, 0x00);
+
+	return ret ? ret : err;
+}
+
+static void imx585_stats_inc(struct imx585 *imx585,
+			     enum imx585_frame_stats field)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&imx585->timing_lock, flags);
+	imx585->stats[field]++;
+	spin_unlock_irqrestore(&imx585->timing_lock, flags);
+}
+
+/* Append the triplets written to the frame queue control */
+static int imx585_frame_queue_push(struct imx585 *imx585,
+				   struct v4l2_ctrl *ctrl)
+{
+	const u32 *vals = ctrl->p_new.p_u32;
+	unsigned int i;
+
+	/* Replaying the stored value at stream on must not queue it again */
+	if (imx585->ctrl_setup)
+		return 0;
+
+	if (kfifo_avail(&imx585->frame_queue) <
+	    ctrl->new_elems / IMX585_FRAME_CTRLS_FIELDS) {
+		imx585_stats_inc(imx585, IMX585_STATS_QUEUE_OVERFLOWS);
+		return -ENOSPC;
+	}
+
+	for (i = 0; i + IMX585_FRAME_CTRLS_FIELDS <= ctrl->new_elems;
+	     i += IMX585_FRAME_CTRLS_FIELDS) {
+		struct imx585_frame_ctrls entry = {
+			.exposure = vals[i],
+			.gain = vals[i + 1],
+			.vblank = vals[i + 2],
+		};
+
+		kfifo_put(&imx585->frame_queue, entry);
+	}
+
+	return 0;
+}
+
+/* Refresh the cached temperature if it is stale, mutex held */
+static int imx585_update_temperature(struct imx585 *imx585)
+{
+	u64 now = ktime_get_ns();
+	int ret, val;
+
+	if (imx585->temp_time_ns &&
+	    now - imx585->temp_time_ns < IMX585_TEMP_INTERVAL_NS)
+		return 0;
+
+	ret = iio_read_channel_processed(imx585->temp_chan, &val);
+	if (ret < 0)
+		return ret;
+
+	imx585->temperature = clamp(val, IMX585_TEMP_MIN, IMX585_TEMP_MAX);
+	imx585->temp_time_ns = now;
+
+	return 0;
+}
+
+static int imx585_g_volatile_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct imx585 *imx585 =
+		container_of(ctrl->handler, struct imx585, ctrl_handler);
+	unsigned long flags;
+	int ret;
+
+	switch (ctrl->id) {
+	case V4L2_CID_IMX585_FRAME_TIMING:
+		spin_lock_irqsave(&imx585->timing_lock, flags);
+		memcpy(ctrl->p_new.p_s64, imx585->timing,
+		       sizeof(imx585->timing));
+		spin_unlock_irqrestore(&imx585->timing_lock, flags);
+		break;
+	case V4L2_CID_IMX585_FRAME_STATS:
+		spin_lock_irqsave(&imx585->timing_lock, flags);
+		memcpy(ctrl->p_new.p_u32, imx585->stats,
+		       sizeof(imx585->stats));
+		spin_unlock_irqrestore(&imx585->timing_lock, flags);
+		break;
+	case V4L2_CID_IMX585_TEMPERATURE:
+		ret = imx585_update_temperature(imx585);
+		if (ret)
+			return ret;
+		ctrl->val = imx585->temperature;
+		break;
+	}
+
+	return 0;
+}
+
+static int imx585_try_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct imx585 *imx585 =
+		container_of(ctrl->handler, struct imx585, ctrl_handler);
+	const struct imx585_mode *mode = imx585->mode;
+	u64 min_exposure, max_exposure;
+
+	/* The frame queue only takes whole (exposure, gain, vblank) entries */
+	if (ctrl->id == V4L2_CID_IMX585_FRAME_QUEUE &&
+	    ctrl->new_elems % IMX585_FRAME_CTRLS_FIELDS)
+		return -EINVAL;
+
+	/*
+	 * Called once for the exposure cluster, with VBLANK as master. Clamp
+	 * the exposure to the frame length it will run at here, where the
+	 * framework stores the change, so G_CTRL reports what is applied.
+	 */
+	if (ctrl->id == V4L2_CID_VBLANK) {
+		calculate_min_max_v4l2_cid_exposure(imx585->HMAX,
+						    (u64)mode->height + ctrl->val,
+						    mode->min_SHR, 0, 0,
+						    &min_exposure, &max_exposure);
+		imx585->exposure->val = clamp_t(u32, imx585->exposure->val,
+						min_exposure, max_exposure);
+
+		/* Only what is left of the GAIN range above the analogue gain */
+		imx585->digital_gain->val =
+			min_t(s32, imx585->digital_gain->val,
+			      IMX585_ANA_GAIN_MAX - imx585->gain->val);
+	}
+
+	return 0;
+}
+
+/* Shortest HMAX of the current mode at a given data rate */
+static u32 imx585_min_hmax(struct imx585 *imx585, unsigned int data_rate)
+{
+	return DIV_ROUND_UP_ULL(imx585->mode->min_HMAX * link_freq_menu_items[0],
+				link_freq_menu_items[data_rate]);
+}
+
+/* Frame period in ns, HMAX counts cycles of the 74.25 MHz clock */
+static u64 imx585_frame_period_ns(struct imx585 *imx585)
+{
+	return div_u64((u64)imx585->VMAX * imx585->HMAX * 1000, 74250);
+}
+
+/* Time to read out the active lines of a frame, in ns */
+static u64 imx585_readout_ns(struct imx585 *imx585)
+{
+	return div_u64((u64)imx585->mode->height * imx585->HMAX * 1000, 74250);
+}
+
+/* Count the capture's frames from the next frame start, mutex held */
+static void imx585_timelapse_count(struct imx585 *imx585)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&imx585->timing_lock, flags);
+	imx585->timelapse_counting = true;
+	imx585->timelapse_frames = 0;
+	spin_unlock_irqrestore(&imx585->timing_lock, flags);
+}
+
+/*
+ * (Re)start the timelapse cycle with a capture now, mutex held. A sensor
+ * in standby is woken at once, a streaming one goes to standby after
+ * this capture.
+ */
+static void imx585_timelapse_kick(struct imx585 *imx585)
+{
+	imx585->timelapse_next = ktime_get_ns();
+	if (imx585->timelapse_standby)
+		mod_delayed_work(system_wq, &imx585->timelapse_work, 0);
+	else
+		imx585_timelapse_count(imx585);
+}
+
+/* Torch keeps the output on, otherwise it is off between pulses */
+static void imx585_flash_set_mode(struct imx585 *imx585, s32 mode)
+{
+	hrtimer_cancel(&imx585->flash_timer);
+	gpiod_set_value(imx585->flash_gpio,
+			mode == V4L2_FLASH_LED_MODE_TORCH);
+}
+
+static void imx585_set_power_profile(struct imx585 *imx585, s32 profile);
+
 static int imx585_set_ctrl(struct v4l2_ctrl *ctrl)
 {
 	struct imx585 *imx585 =
@@ -748,62 +1442,76 @@ static int imx585_set_ctrl(struct v4l2_ctrl *ctrl)
 
 	int ret = 0;
 
-        u64 shr,hmax = 0;
+        u64 hmax = 0;
 	/*
-	 * The VBLANK control may change the limits of usable exposure, so check
-	 * and adjust if necessary.
+	 * VBLANK, EXPOSURE, ANALOGUE_GAIN and DIGITAL_GAIN are one cluster with
+	 * VBLANK as master, so we get here once per S_EXT_CTRLS with every new
+	 * value in place, the exposure already clamped by imx585_try_ctrl().
 	 */
-	if (ctrl->id == V4L2_CID_VBLANK){
-		/* Honour the VBLANK limits when setting exposure. */
-		u64 current_exposure, max_exposure, min_exposure, vmax;
-		vmax = ((u64)mode->height + ctrl->val) ;
-		imx585 -> VMAX = vmax;
-		
-		calculate_min_max_v4l2_cid_exposure(imx585 -> HMAX, imx585 -> VMAX, (u64)mode->min_SHR, 0, 0, &min_exposure, &max_exposure);
-		current_exposure = clamp_t(uint32_t, current_exposure, min_exposure, max_exposure);
+	if (ctrl->id == V4L2_CID_VBLANK) {
+		imx585 -> VMAX = (u64)mode->height + ctrl->val;
+
+		/* A VBLANK set by the user is where throttling unwinds to */
+		if (ctrl->is_new && !imx585->thermal_update)
+			imx585->thermal_vblank = ctrl->val;
+	}
+
+	/* Entering or leaving trigger mode changes the frame length limits */
+	if (ctrl->id == V4L2_CID_IMX585_SYNC_MODE)
+		imx585_update_vblank_range(imx585);
+
+	/* Queued entries are written by the frame work, not here */
+	if (ctrl->id == V4L2_CID_IMX585_FRAME_QUEUE)
+		return imx585_frame_queue_push(imx585, ctrl);
+
+	/* The flash is a GPIO, the timeout is applied at the next pulse */
+	if (ctrl->id == V4L2_CID_FLASH_LED_MODE) {
+		imx585_flash_set_mode(imx585, ctrl->val);
+		return 0;
+	}
+	if (ctrl->id == V4L2_CID_FLASH_TIMEOUT)
+		return 0;
+
+	/* Picked up by the thermal governor at its next run */
+	if (ctrl->id == V4L2_CID_IMX585_THERMAL_LIMIT)
+		return 0;
+
+	/* Replayed at stream on, the data rate is written by imx585_program() */
+	if (ctrl->id == V4L2_CID_IMX585_POWER_PROFILE) {
+		if (!imx585->ctrl_setup)
+			imx585_set_power_profile(imx585, ctrl->val);
+		return 0;
+	}
 
-		dev_info(&client->dev,"exposure_max:%lld, exposure_min:%lld, current_exposure:%lld\n",max_exposure, min_exposure, current_exposure);
-		dev_info(&client->dev,"\tVMAX:%d, HMAX:%d\n",imx585->VMAX, imx585->HMAX);
-		__v4l2_ctrl_modify_range(imx585->exposure, min_exposure,max_exposure, 1,current_exposure);
+	if (ctrl->id == V4L2_CID_IMX585_TIMELAPSE) {
+		if (imx585->streaming && !imx585->ctrl_setup)
+			imx585_timelapse_kick(imx585);
+		return 0;
 	}
 
 	/*
 	 * Applying V4L2 control value only happens
 	 * when power is up for streaming
 	 */
-	if (pm_runtime_get_if_in_use(&client->dev) == 0)
+	if (pm_runtime_get_if_in_use(&client->dev) == 0) {
+		/* Not in the staged registers either, program at stream on */
+		if (!imx585->ctrl_setup)
+			imx585->staged = false;
 		return 0;
+	}
 
 	
 	switch (ctrl->id) {
-	case V4L2_CID_EXPOSURE:
-		{
-		dev_info(&client->dev,"V4L2_CID_EXPOSURE : %d\n",ctrl->val);
-		dev_info(&client->dev,"\tvblank:%d, hblank:%d\n",imx585->vblank->val, imx585->hblank->val);
-		dev_info(&client->dev,"\tVMAX:%d, HMAX:%d\n",imx585->VMAX, imx585->HMAX);
-		shr = calculate_shr(ctrl->val, imx585->HMAX, imx585->VMAX, 0, 0);
-		dev_info(&client->dev,"\tSHR:%lld\n",shr);
-		ret = imx585_write_reg_2byte(imx585, IMX585_REG_SHR, shr);
-		}
-		break;
-	case V4L2_CID_ANALOGUE_GAIN:
-		dev_info(&client->dev,"V4L2_CID_ANALOGUE_GAIN : %d\n",ctrl->val);
-		ret = imx585_write_reg_2byte(imx585, IMX585_REG_ANALOG_GAIN, ctrl->val);
-		break;
 	case V4L2_CID_VBLANK:
-		{
-		//dev_info(&client->dev,"V4L2_CID_VBLANK : %d\n",ctrl->val);
-		imx585 -> VMAX = ((u64)mode->height + ctrl->val) ;
-		//dev_info(&client->dev,"\tVMAX : %d\n",imx585 -> VMAX);
-		ret = imx585_write_reg_3byte(imx585, IMX585_REG_VMAX, imx585 -> VMAX);
-		}
+		ret = imx585_write_exposure_regs(imx585, imx585->exposure->val,
+						 imx585_gain_code(imx585, imx585->gain->val));
 		break;
 	case V4L2_CID_HBLANK:
 		{
 		//dev_info(&client->dev,"V4L2_CID_HBLANK : %d\n",ctrl->val);
 		//int hmax = (IMX585_NATIVE_WIDTH + ctrl->val) * 72000000; / IMX585_PIXEL_RATE;
 		u64 pixel_rate = (u64)mode->width * 74250000;
-		do_div(pixel_rate,mode->min_HMAX);
+		do_div(pixel_rate, imx585_min_hmax(imx585, imx585->data_rate));
 		hmax = (u64)(mode->width + ctrl->val) * 74250000;
 		do_div(hmax,pixel_rate);
 		imx585 -> HMAX = hmax;
@@ -811,6 +1519,18 @@ static int imx585_set_ctrl(struct v4l2_ctrl *ctrl)
 		ret = imx585_write_reg_2byte(imx585, IMX585_REG_HMAX, hmax);
 		}
 		break;
+	case V4L2_CID_IMX585_SYNC_MODE:
+		ret = imx585_write_reg_1byte(imx585, IMX585_REG_XXS_DRV,
+					     ctrl->val == IMX585_SYNC_MASTER ?
+					     IMX585_XXS_DRV_OUTPUT :
+					     IMX585_XXS_DRV_HIZ);
+		break;
+	case V4L2_CID_IMX585_BLACK_LEVEL:
+		ret = imx585_write_reg_2byte(imx585, IMX585_REG_BLKLEVEL, ctrl->val);
+		break;
+	case V4L2_CID_HFLIP:
+		ret = imx585_write_reg_1byte(imx585, IMX585_REG_HFLIP, imx585->hflip->val);
+		break;
 	case V4L2_CID_VFLIP:
 		//dev_info(&client->dev,"V4L2_CID_VFLIP : %d\n",imx585->vflip->val);
 		ret = imx585_write_reg_1byte(imx585, IMX585_REG_VFLIP, imx585->vflip->val);
@@ -829,9 +1549,174 @@ static int imx585_set_ctrl(struct v4l2_ctrl *ctrl)
 }
 
 static const struct v4l2_ctrl_ops imx585_ctrl_ops = {
+	.g_volatile_ctrl = imx585_g_volatile_ctrl,
+	.try_ctrl = imx585_try_ctrl,
 	.s_ctrl = imx585_set_ctrl,
 };
 
+/*
+ * Each write appends (exposure, analogue gain, vblank) triplets to the
+ * per-frame queue. Entries override the cluster values for their frame and
+ * the last one stays in effect until the controls are written again.
+ */
+static const struct v4l2_ctrl_config imx585_frame_queue_ctrl = {
+	.ops = &imx585_ctrl_ops,
+	.id = V4L2_CID_IMX585_FRAME_QUEUE,
+	.name = "Per-frame Controls",
+	.type = V4L2_CTRL_TYPE_U32,
+	.flags = V4L2_CTRL_FLAG_DYNAMIC_ARRAY |
+		 V4L2_CTRL_FLAG_EXECUTE_ON_WRITE,
+	.max = U32_MAX,
+	.step = 1,
+	.dims = { IMX585_FRAME_QUEUE_DEPTH * IMX585_FRAME_CTRLS_FIELDS },
+};
+
+static const struct v4l2_ctrl_config imx585_black_level_ctrl = {
+	.ops = &imx585_ctrl_ops,
+	.id = V4L2_CID_IMX585_BLACK_LEVEL,
+	.name = "Black Level",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = IMX585_BLKLEVEL_MIN,
+	.max = IMX585_BLKLEVEL_MAX,
+	.step = IMX585_BLKLEVEL_STEP,
+	.def = IMX585_BLKLEVEL_DEFAULT,
+};
+
+static const char * const imx585_power_profile_menu[] = {
+	[IMX585_PROFILE_PERFORMANCE] = "Performance",
+	[IMX585_PROFILE_BALANCED] = "Balanced",
+	[IMX585_PROFILE_LOW_POWER] = "Low Power",
+};
+
+static const struct v4l2_ctrl_config imx585_power_profile_ctrl = {
+	.ops = &imx585_ctrl_ops,
+	.id = V4L2_CID_IMX585_POWER_PROFILE,
+	.name = "Power Profile",
+	.type = V4L2_CTRL_TYPE_MENU,
+	.max = ARRAY_SIZE(imx585_power_profile_menu) - 1,
+	.def = IMX585_PROFILE_PERFORMANCE,
+	.qmenu = imx585_power_profile_menu,
+};
+
+static const char * const imx585_sync_mode_menu[] = {
+	[IMX585_SYNC_MASTER] = "Master",
+	[IMX585_SYNC_SLAVE] = "Slave",
+	[IMX585_SYNC_TRIGGER] = "External Trigger",
+};
+
+/*
+ * On a slave the frame and line period come from the external XVS/XHS, but
+ * SHR is still counted against VMAX, so VBLANK and HBLANK must be set to the
+ * master's values for exposures to match across the rig.
+ */
+static const struct v4l2_ctrl_config imx585_sync_mode_ctrl = {
+	.ops = &imx585_ctrl_ops,
+	.id = V4L2_CID_IMX585_SYNC_MODE,
+	.name = "Sync Mode",
+	.type = V4L2_CTRL_TYPE_MENU,
+	.max = ARRAY_SIZE(imx585_sync_mode_menu) - 1,
+	.qmenu = imx585_sync_mode_menu,
+};
+
+/*
+ * Sequence, frame start and first line exposure start/end of the last frame,
+ * see enum imx585_frame_timing. Frame starts are XVS edges when xvs-gpios
+ * is wired up and estimated from stream on and VMAX x HMAX otherwise.
+ */
+static const struct v4l2_ctrl_config imx585_frame_timing_ctrl = {
+	.ops = &imx585_ctrl_ops,
+	.id = V4L2_CID_IMX585_FRAME_TIMING,
+	.name = "Frame Timing",
+	.type = V4L2_CTRL_TYPE_INTEGER64,
+	.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+	.min = 0,
+	.max = S64_MAX,
+	.step = 1,
+	.dims = { IMX585_TIMING_FIELDS },
+};
+
+/* Module temperature in millidegrees Celsius, needs a temperature IIO channel */
+static const struct v4l2_ctrl_config imx585_temperature_ctrl = {
+	.ops = &imx585_ctrl_ops,
+	.id = V4L2_CID_IMX585_TEMPERATURE,
+	.name = "Sensor Temperature",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+	.min = IMX585_TEMP_MIN,
+	.max = IMX585_TEMP_MAX,
+	.step = 1,
+	.def = 25000,
+};
+
+/* Capture interval in ms with standby in between, 0 streams continuously */
+static const struct v4l2_ctrl_config imx585_timelapse_ctrl = {
+	.ops = &imx585_ctrl_ops,
+	.id = V4L2_CID_IMX585_TIMELAPSE,
+	.name = "Timelapse Interval",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = IMX585_TIMELAPSE_MIN_MS,
+	.max = IMX585_TIMELAPSE_MAX_MS,
+	.step = 1,
+	.def = 0,
+};
+
+/* Thermal governor VBLANK throttling limit in millidegrees, 0 disables */
+static const struct v4l2_ctrl_config imx585_thermal_limit_ctrl = {
+	.ops = &imx585_ctrl_ops,
+	.id = V4L2_CID_IMX585_THERMAL_LIMIT,
+	.name = "Thermal Throttle Limit",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 0,
+	.max = IMX585_TEMP_MAX,
+	.step = 1,
+	.def = 0,
+};
+
+/* Frame counters of the running stream, see enum imx585_frame_stats */
+static const struct v4l2_ctrl_config imx585_frame_stats_ctrl = {
+	.ops = &imx585_ctrl_ops,
+	.id = V4L2_CID_IMX585_FRAME_STATS,
+	.name = "Frame Statistics",
+	.type = V4L2_CTRL_TYPE_U32,
+	.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+	.min = 0,
+	.max = U32_MAX,
+	.step = 1,
+	.dims = { IMX585_STATS_FIELDS },
+};
+
+/* Read-only delays of the controls applied through imx585_ctrl_ops */
+static const struct v4l2_ctrl_config imx585_delay_ctrls[] = {
+	{
+		.id = V4L2_CID_IMX585_EXPOSURE_DELAY,
+		.name = "Exposure Delay",
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.flags = V4L2_CTRL_FLAG_READ_ONLY,
+		.min = IMX585_EXPOSURE_DELAY,
+		.max = IMX585_EXPOSURE_DELAY,
+		.step = 1,
+		.def = IMX585_EXPOSURE_DELAY,
+	}, {
+		.id = V4L2_CID_IMX585_GAIN_DELAY,
+		.name = "Analogue Gain Delay",
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.flags = V4L2_CTRL_FLAG_READ_ONLY,
+		.min = IMX585_GAIN_DELAY,
+		.max = IMX585_GAIN_DELAY,
+		.step = 1,
+		.def = IMX585_GAIN_DELAY,
+	}, {
+		.id = V4L2_CID_IMX585_VBLANK_DELAY,
+		.name = "Vertical Blanking Delay",
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.flags = V4L2_CTRL_FLAG_READ_ONLY,
+		.min = IMX585_VBLANK_DELAY,
+		.max = IMX585_VBLANK_DELAY,
+		.step = 1,
+		.def = IMX585_VBLANK_DELAY,
+	},
+};
+
 static int imx585_enum_mbus_code(struct v4l2_subdev *sd,
 				 struct v4l2_subdev_state *sd_state,
 				 struct v4l2_subdev_mbus_code_enum *code)
@@ -883,12 +1768,19 @@ static int imx585_enum_frame_size(struct v4l2_subdev *sd,
 		fse->min_height = mode_list[fse->index].height;
 		fse->max_height = fse->min_height;
 	} else {
-		if (fse->code != MEDIA_BUS_FMT_SENSOR_DATA || fse->index > 0)
+		const struct imx585_mode *mode_list;
+		unsigned int num_modes;
+
+		/* One size per mode of the current image format */
+		get_mode_table(imx585->fmt_code, &mode_list, &num_modes);
+
+		if (fse->code != MEDIA_BUS_FMT_SENSOR_DATA ||
+		    fse->index >= num_modes)
 			return -EINVAL;
 
-		fse->min_width = IMX585_EMBEDDED_LINE_WIDTH;
+		fse->min_width = mode_list[fse->index].embedded_width;
 		fse->max_width = fse->min_width;
-		fse->min_height = IMX585_NUM_EMBEDDED_LINES;
+		fse->min_height = mode_list[fse->index].embedded_lines;
 		fse->max_height = fse->min_height;
 	}
 
@@ -915,10 +1807,11 @@ static void imx585_update_image_pad_format(struct imx585 *imx585,
 	imx585_reset_colorspace(&fmt->format);
 }
 
-static void imx585_update_metadata_pad_format(struct v4l2_subdev_format *fmt)
+static void imx585_update_metadata_pad_format(const struct imx585_mode *mode,
+					      struct v4l2_subdev_format *fmt)
 {
-	fmt->format.width = IMX585_EMBEDDED_LINE_WIDTH;
-	fmt->format.height = IMX585_NUM_EMBEDDED_LINES;
+	fmt->format.width = mode->embedded_width;
+	fmt->format.height = mode->embedded_lines;
 	fmt->format.code = MEDIA_BUS_FMT_SENSOR_DATA;
 	fmt->format.field = V4L2_FIELD_NONE;
 }
@@ -950,7 +1843,7 @@ static int imx585_get_pad_format(struct v4l2_subdev *sd,
 			fmt->format.code =
 			       imx585_get_format_code(imx585, imx585->fmt_code);
 		} else {
-			imx585_update_metadata_pad_format(fmt);
+			imx585_update_metadata_pad_format(imx585->mode, fmt);
 		}
 	}
 
@@ -965,18 +1858,20 @@ static void imx585_set_framing_limits(struct imx585 *imx585)
 	const struct imx585_mode *mode = imx585->mode;
 	u64 def_hblank;
 	u64 pixel_rate;
+	u64 min_exposure, max_exposure, unused;
+	u32 min_hmax = imx585_min_hmax(imx585, imx585->data_rate);
 
 
 	imx585->VMAX = mode->default_VMAX;
-	imx585->HMAX = mode->default_HMAX;
+	imx585->HMAX = max_t(u32, mode->default_HMAX, min_hmax);
 
 	pixel_rate = (u64)mode->width * 74250000;
-	do_div(pixel_rate,mode->min_HMAX);
+	do_div(pixel_rate, min_hmax);
 	dev_info(&client->dev,"Pixel Rate : %lld\n",pixel_rate);
 
 
 	//int def_hblank = mode->default_HMAX * IMX585_PIXEL_RATE / 72000000 - IMX585_NATIVE_WIDTH;
-	def_hblank = mode->default_HMAX * pixel_rate;
+	def_hblank = imx585->HMAX * pixel_rate;
 	do_div(def_hblank,74250000);
 	def_hblank = def_hblank - mode->width;
 	__v4l2_ctrl_modify_range(imx585->hblank, def_hblank,
@@ -988,18 +1883,70 @@ static void imx585_set_framing_limits(struct imx585 *imx585)
 
 
 	/* Update limits and set FPS to default */
-	__v4l2_ctrl_modify_range(imx585->vblank, mode->min_VMAX - mode->height,
-				 IMX585_VMAX_MAX - mode->height,
-				 1, mode->default_VMAX - mode->height);
-	__v4l2_ctrl_s_ctrl(imx585->vblank, mode->default_VMAX - mode->height);
+	imx585_update_vblank_range(imx585);
+	/*
+	 * Exposure is clamped to the frame length inside the exposure cluster,
+	 * so advertise everything reachable up to the longest frame here.
+	 */
+	calculate_min_max_v4l2_cid_exposure(imx585->HMAX, mode->default_VMAX,
+					    mode->min_SHR, 0, 0,
+					    &min_exposure, &unused);
+	calculate_min_max_v4l2_cid_exposure(imx585->HMAX, IMX585_VMAX_MAX,
+					    mode->min_SHR, 0, 0,
+					    &unused, &max_exposure);
+	__v4l2_ctrl_modify_range(imx585->exposure, min_exposure, max_exposure,
+				 IMX585_EXPOSURE_STEP,
+				 clamp_t(u64, IMX585_EXPOSURE_DEFAULT,
+					 min_exposure, max_exposure));
+
+	__v4l2_ctrl_s_ctrl(imx585->vblank, imx585->vblank->default_value);
 
-	/* Setting this will adjust the exposure limits as well. */
 
 	__v4l2_ctrl_modify_range(imx585->pixel_rate, pixel_rate, pixel_rate, 1, pixel_rate);
 
-	dev_info(&client->dev,"Setting default HBLANK : %lld, VBLANK : %lld with PixelRate: %lld\n",def_hblank,mode->default_VMAX - mode->height, pixel_rate);
+	dev_info(&client->dev,"Setting default HBLANK : %lld, VBLANK : %lld with PixelRate: %lld\n",def_hblank,imx585->vblank->default_value, pixel_rate);
+
+}
+/* Switch link frequency for a power profile, not while streaming */
+static void imx585_set_power_profile(struct imx585 *imx585, s32 profile)
+{
+	const struct imx585_mode *mode = imx585->mode;
+	/* Frame interval in 74.25 MHz clocks */
+	u64 period = (u64)imx585->VMAX * imx585->HMAX;
+	unsigned int i;
+	u64 vmax;
+
+	switch (profile) {
+	case IMX585_PROFILE_BALANCED:
+		i = 1;
+		break;
+	case IMX585_PROFILE_LOW_POWER:
+		for (i = ARRAY_SIZE(link_freq_menu_items) - 1; i > 0; i--)
+			if ((u64)imx585_min_hmax(imx585, i) * mode->min_VMAX <=
+			    period)
+				break;
+		break;
+	default:
+		i = 0;
+		break;
+	}
 
+	/* DATARATE_SEL is only written by imx585_program() */
+	imx585->data_rate = i;
+	imx585->staged = false;
+	__v4l2_ctrl_s_ctrl(imx585->link_freq, i);
+	imx585_set_framing_limits(imx585);
+
+	/* Stretch VBLANK back to the interval the rate was picked for */
+	if (profile == IMX585_PROFILE_LOW_POWER) {
+		vmax = div_u64(period, imx585->HMAX);
+		__v4l2_ctrl_s_ctrl(imx585->vblank,
+				   clamp_t(s64, vmax - mode->height,
+					   imx585->vblank->minimum,
+					   imx585->vblank->maximum));
+	}
 }
+
 /* TODO */
 static int imx585_set_pad_format(struct v4l2_subdev *sd,
 				 struct v4l2_subdev_state *sd_state,
@@ -1034,19 +1981,33 @@ static int imx585_set_pad_format(struct v4l2_subdev *sd,
 			framefmt = v4l2_subdev_get_try_format(sd, sd_state,
 							      fmt->pad);
 			*framefmt = fmt->format;
-		} else if (imx585->mode != mode) {
-			imx585->mode = mode;
-			imx585->fmt_code = fmt->format.code;
-			imx585_set_framing_limits(imx585);
+
+			/* The embedded data size follows the image mode */
+			framefmt = v4l2_subdev_get_try_format(sd, sd_state,
+							      METADATA_PAD);
+			framefmt->width = mode->embedded_width;
+			framefmt->height = mode->embedded_lines;
+		} else {
+			if (imx585->mode != mode) {
+				imx585->mode = mode;
+				imx585->fmt_code = fmt->format.code;
+				imx585_set_framing_limits(imx585);
+				imx585->staged = false;
+			}
+
+			/* Stream on is close, start bringing the sensor up */
+			if (!imx585->streaming)
+				queue_work(system_unbound_wq,
+					   &imx585->stage_work);
 		}
 	} else {
+		/* Embedded data size is set by the image pad */
 		if (fmt->which == V4L2_SUBDEV_FORMAT_TRY) {
 			framefmt = v4l2_subdev_get_try_format(sd, sd_state,
 							      fmt->pad);
-			*framefmt = fmt->format;
+			fmt->format = *framefmt;
 		} else {
-			/* Only one embedded data mode is supported */
-			imx585_update_metadata_pad_format(fmt);
+			imx585_update_metadata_pad_format(imx585->mode, fmt);
 		}
 	}
 
@@ -1070,14 +2031,268 @@ __imx585_get_pad_crop(struct imx585 *imx585,
 	return NULL;
 }
 
-/* Start streaming */
-static int imx585_start_streaming(struct imx585 *imx585)
+/* Programmed exposure time in ns */
+static u64 imx585_exposure_ns(struct imx585 *imx585)
+{
+	return div_u64((u64)READ_ONCE(imx585->exposure_lines) *
+		       imx585->HMAX * 1000, 74250);
+}
+
+static enum hrtimer_restart imx585_flash_timer_fn(struct hrtimer *timer)
+{
+	struct imx585 *imx585 = container_of(timer, struct imx585, flash_timer);
+	u64 end = READ_ONCE(imx585->flash_end);
+
+	if (ktime_get_ns() < end) {
+		gpiod_set_value(imx585->flash_gpio, 1);
+		hrtimer_set_expires(timer, ns_to_ktime(end));
+		return HRTIMER_RESTART;
+	}
+
+	gpiod_set_value(imx585->flash_gpio, 0);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Pulse the flash over the first line's integration of the next frame,
+ * which ends one frame period after this frame start. Later lines start
+ * one line period apart, so exposures longer than the readout get the
+ * whole frame lit. A pulse still running when the next one is armed is
+ * simply extended.
+ */
+static void imx585_flash_schedule(struct imx585 *imx585, u64 timestamp,
+				  u64 exposure_ns)
+{
+	u64 pulse_ns, start;
+
+	if (!imx585->flash_gpio ||
+	    imx585->flash_mode->val != V4L2_FLASH_LED_MODE_FLASH)
+		return;
+
+	pulse_ns = min_t(u64, exposure_ns,
+			 (u64)imx585->flash_timeout->val * NSEC_PER_USEC);
+	start = timestamp + imx585_frame_period_ns(imx585) - exposure_ns;
+
+	WRITE_ONCE(imx585->flash_end, start + pulse_ns);
+	hrtimer_start(&imx585->flash_timer, ns_to_ktime(start),
+		      HRTIMER_MODE_ABS);
+}
+
+/*
+ * Called once per frame start, possibly from atomic context, with the
+ * CLOCK_MONOTONIC time of the frame start. Returns the frame sequence.
+ */
+static u32 imx585_frame_start(struct imx585 *imx585, u64 timestamp)
+{
+	u32 sequence = atomic_inc_return(&imx585->frame_sequence) - 1;
+	unsigned long flags;
+	u64 exposure_ns;
+
+	spin_lock_irqsave(&imx585->timing_lock, flags);
+	/*
+	 * XVS interrupts can be missed, estimated frame starts cannot.
+	 * Triggered frames and timelapse standby leave gaps by design.
+	 */
+	if (imx585->xvs_gpio && sequence && !imx585->timing_resync &&
+	    imx585->sync_mode->val != IMX585_SYNC_TRIGGER) {
+		u64 period = imx585_frame_period_ns(imx585);
+		u64 gap = timestamp - imx585->timing[IMX585_TIMING_FRAME_START];
+		u64 frames = div64_u64(gap + period / 2, period);
+
+		if (frames > 1)
+			imx585->stats[IMX585_STATS_MISSED_FRAMES] += frames - 1;
+	}
+	imx585->timing_resync = false;
+	/* Last frame of a timelapse capture, standby once it is read out */
+	if (imx585->timelapse_counting &&
+	    ++imx585->timelapse_frames == IMX585_TIMELAPSE_FRAMES) {
+		imx585->timelapse_counting = false;
+		imx585->timelapse_readout_end = timestamp +
+						imx585_readout_ns(imx585);
+		mod_delayed_work(system_wq, &imx585->timelapse_work, 0);
+	}
+	imx585->stats[IMX585_STATS_FRAMES]++;
+	imx585->timing[IMX585_TIMING_SEQUENCE] = sequence;
+	imx585->timing[IMX585_TIMING_FRAME_START] = timestamp;
+	imx585->timing[IMX585_TIMING_EXPOSURE_START] =
+		timestamp - imx585->latched_exposure_ns;
+	imx585->timing[IMX585_TIMING_EXPOSURE_END] = timestamp;
+	exposure_ns = imx585_exposure_ns(imx585);
+	imx585->latched_exposure_ns = exposure_ns;
+	spin_unlock_irqrestore(&imx585->timing_lock, flags);
+
+	imx585_flash_schedule(imx585, timestamp, exposure_ns);
+
+	if (!kfifo_is_empty(&imx585->frame_queue)) {
+		WRITE_ONCE(imx585->frame_work_sequence, sequence);
+		queue_work(system_highpri_wq, &imx585->frame_work);
+	}
+
+	return sequence;
+}
+
+/* Timestamp the XVS edge as early as possible, the rest runs threaded */
+static irqreturn_t imx585_xvs_irq(int irq, void *data)
+{
+	struct imx585 *imx585 = data;
+
+	imx585->xvs_timestamp = ktime_get_ns();
+
+	return IRQ_WAKE_THREAD;
+}
+
+static irqreturn_t imx585_xvs_irq_thread(int irq, void *data)
+{
+	struct imx585 *imx585 = data;
+	struct v4l2_event ev = {
+		.type = V4L2_EVENT_FRAME_SYNC,
+	};
+	u64 timestamp = imx585->xvs_timestamp;
+
+	/* Nested GPIO interrupts never run the primary handler */
+	if (!timestamp)
+		timestamp = ktime_get_ns();
+	imx585->xvs_timestamp = 0;
+
+	ev.u.frame_sync.frame_sequence = imx585_frame_start(imx585, timestamp);
+	v4l2_subdev_notify_event(&imx585->sd, &ev);
+
+	return IRQ_HANDLED;
+}
+
+static enum hrtimer_restart imx585_frame_timer_fn(struct hrtimer *timer)
+{
+	struct imx585 *imx585 = container_of(timer, struct imx585, frame_timer);
+
+	/* The estimate is stream on time plus whole frame periods */
+	imx585_frame_start(imx585, ktime_to_ns(hrtimer_get_expires(timer)));
+	hrtimer_forward_now(timer, ns_to_ktime(imx585_frame_period_ns(imx585)));
+
+	return HRTIMER_RESTART;
+}
+
+/* Apply the next queued entry of per-frame controls */
+static void imx585_frame_work(struct work_struct *work)
+{
+	struct imx585 *imx585 = container_of(work, struct imx585, frame_work);
+	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
+	const struct imx585_mode *mode;
+	struct imx585_frame_ctrls entry;
+	u64 min_exposure, max_exposure;
+	u32 vblank, exposure, gain;
+	int ret;
+
+	mutex_lock(&imx585->mutex);
+
+	/* Stream off cancels the timer but leaves a running work to exit here */
+	if (!imx585->streaming || !kfifo_get(&imx585->frame_queue, &entry))
+		goto out;
+
+	mode = imx585->mode;
+	vblank = clamp_t(u32, entry.vblank, imx585->vblank->minimum,
+			 imx585->vblank->maximum);
+	imx585->VMAX = mode->height + vblank;
+
+	calculate_min_max_v4l2_cid_exposure(imx585->HMAX, imx585->VMAX,
+					    mode->min_SHR, 0, 0,
+					    &min_exposure, &max_exposure);
+	exposure = clamp_t(u32, entry.exposure, min_exposure, max_exposure);
+	gain = clamp_t(u32, entry.gain, imx585->gain->minimum,
+		       imx585->gain->maximum);
+	gain = imx585_gain_code(imx585, gain);
+
+	ret = imx585_write_exposure_regs(imx585, exposure, gain);
+	if (ret)
+		dev_err_ratelimited(&client->dev,
+				    "failed to apply queued controls (%d)\n",
+				    ret);
+
+	/* Missed the frame it was meant for, it lands one frame later */
+	if (atomic_read(&imx585->frame_sequence) - 1 !=
+	    READ_ONCE(imx585->frame_work_sequence))
+		imx585_stats_inc(imx585, IMX585_STATS_LATE_UPDATES);
+out:
+	mutex_unlock(&imx585->mutex);
+}
+
+static void imx585_thermal_work(struct work_struct *work)
+{
+	struct imx585 *imx585 = container_of(to_delayed_work(work),
+					     struct imx585, thermal_work);
+	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
+	s32 limit, vblank;
+	bool hot = false, cool = true;
+	int ret;
+
+	mutex_lock(&imx585->mutex);
+
+	if (!imx585->streaming)
+		goto out;
+
+	/* A limit of 0 disables throttling and lets it unwind */
+	limit = imx585->thermal_limit->val;
+	if (limit) {
+		ret = imx585_update_temperature(imx585);
+		if (ret) {
+			dev_warn_ratelimited(&client->dev,
+					     "failed to read temperature (%d)\n",
+					     ret);
+			goto requeue;
+		}
+		hot = imx585->temperature >= limit;
+		cool = imx585->temperature < limit - IMX585_THERMAL_HYSTERESIS;
+	}
+
+	vblank = imx585->vblank->val;
+	if (hot && vblank < imx585->vblank->maximum) {
+		if (!imx585->thermal_throttled) {
+			imx585->thermal_throttled = true;
+			imx585->thermal_vblank = vblank;
+		}
+		vblank = min_t(s32, vblank + IMX585_THERMAL_VBLANK_STEP,
+			       imx585->vblank->maximum);
+	} else if (cool && imx585->thermal_throttled) {
+		vblank = max_t(s32, vblank - IMX585_THERMAL_VBLANK_STEP,
+			       imx585->thermal_vblank);
+		imx585->thermal_throttled = vblank > imx585->thermal_vblank;
+	}
+
+	/* Goes through the control so subscribers get a change event */
+	if (vblank != imx585->vblank->val) {
+		dev_dbg(&client->dev, "thermal: %d mC, vblank %d\n",
+			imx585->temperature, vblank);
+		imx585->thermal_update = true;
+		__v4l2_ctrl_s_ctrl(imx585->vblank, vblank);
+		imx585->thermal_update = false;
+	}
+
+requeue:
+	queue_delayed_work(system_wq, &imx585->thermal_work,
+			   msecs_to_jiffies(IMX585_THERMAL_INTERVAL_MS));
+out:
+	mutex_unlock(&imx585->mutex);
+}
+
+/* Record the time since start for a stream start phase, mutex held */
+static void imx585_phase_done(struct imx585 *imx585, enum imx585_phase phase,
+			      ktime_t start)
+{
+	unsigned int i = imx585->phase_count[phase]++ % IMX585_PHASE_SAMPLES;
+
+	imx585->phase_us[phase][i] = ktime_us_delta(ktime_get(), start);
+}
+
+/* Program common and mode registers and controls, sensor in standby */
+static int imx585_program(struct imx585 *imx585)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
 	const struct IMX585_reg_list *reg_list;
+	ktime_t start;
 	int ret;
 
 	if (!imx585->common_regs_written) {
+		start = ktime_get();
 		ret = imx585_write_regs(imx585, mode_common_regs,
 					ARRAY_SIZE(mode_common_regs));
 		if (ret) {
@@ -1085,41 +2300,276 @@ static int imx585_start_streaming(struct imx585 *imx585)
 				__func__);
 			return ret;
 		}
+		reg_list = &imx585->compatible_data->extra_regs;
+		ret = imx585_write_regs(imx585, reg_list->regs,
+					reg_list->num_of_regs);
+		if (ret) {
+			dev_err(&client->dev, "%s failed to set variant settings\n",
+				__func__);
+			return ret;
+		}
+
 		imx585->common_regs_written = true;
+		imx585_phase_done(imx585, IMX585_PHASE_COMMON_REGS, start);
+	}
+
+	ret = imx585_write_reg_1byte(imx585, IMX585_REG_DATARATE_SEL,
+				     imx585_datarate_sel[imx585->data_rate]);
+	if (ret) {
+		dev_err(&client->dev, "%s failed to set data rate\n", __func__);
+		return ret;
 	}
 
 	/* Apply default values of current mode */
+	start = ktime_get();
 	reg_list = &imx585->mode->reg_list;
 	ret = imx585_write_regs(imx585, reg_list->regs, reg_list->num_of_regs);
 	if (ret) {
 		dev_err(&client->dev, "%s failed to set mode\n", __func__);
 		return ret;
 	}
+	imx585_phase_done(imx585, IMX585_PHASE_MODE_REGS, start);
 
 	/* Apply customized values from user */
+	start = ktime_get();
+	imx585->ctrl_setup = true;
 	ret =  __v4l2_ctrl_handler_setup(imx585->sd.ctrl_handler);
+	imx585->ctrl_setup = false;
+	if (ret)
+		return ret;
+	imx585_phase_done(imx585, IMX585_PHASE_CTRL_SETUP, start);
 
-	return ret;
+	return 0;
 }
 
-/* Stop streaming */
-static void imx585_stop_streaming(struct imx585 *imx585)
+static void imx585_stage_work(struct work_struct *work)
 {
+	struct imx585 *imx585 = container_of(work, struct imx585, stage_work);
 	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
+	ktime_t start;
+	bool powered;
 	int ret;
 
+	mutex_lock(&imx585->mutex);
+
+	if (imx585->streaming)
+		goto out;
+
+	start = ktime_get();
+	powered = pm_runtime_active(&client->dev);
+	ret = pm_runtime_resume_and_get(&client->dev);
+	if (ret) {
+		dev_err(&client->dev, "%s failed to power up (%d)\n",
+			__func__, ret);
+		goto out;
+	}
+	/* One sample per actual power up */
+	if (!powered)
+		imx585_phase_done(imx585, IMX585_PHASE_POWER_ON, start);
+
+	/* A failure here is retried by imx585_start_streaming() */
+	if (!imx585->staged)
+		imx585->staged = !imx585_program(imx585);
+
+	/* Powered down again if stream on does not follow in time */
+	pm_runtime_mark_last_busy(&client->dev);
+	pm_runtime_put_autosuspend(&client->dev);
+out:
+	mutex_unlock(&imx585->mutex);
+}
+
+/* Leave standby, then let the master start generating sync */
+static int imx585_leave_standby(struct imx585 *imx585)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
+	int ret;
+
+	ret = imx585_write_reg_1byte(imx585, IMX585_REG_MODE_SELECT,
+				     IMX585_MODE_STREAMING);
+	if (ret) {
+		dev_err(&client->dev, "%s failed to set stream\n", __func__);
+		return ret;
+	}
+
+	usleep_range(IMX585_STANDBY_EXIT_DELAY_US,
+		     IMX585_STANDBY_EXIT_DELAY_US + 1000);
+
+	if (imx585->sync_mode->val == IMX585_SYNC_MASTER) {
+		ret = imx585_write_reg_1byte(imx585, IMX585_REG_XMSTA,
+					     IMX585_XMSTA_START);
+		if (ret) {
+			dev_err(&client->dev, "%s failed to start master mode\n",
+				__func__);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static void imx585_enter_standby(struct imx585 *imx585)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
+	int ret;
+
+	ret = imx585_write_reg_1byte(imx585, IMX585_REG_XMSTA, IMX585_XMSTA_STOP);
+	if (ret)
+		dev_err(&client->dev, "%s failed to stop master mode\n", __func__);
+
 	/* set stream off register */
 	ret = imx585_write_reg_1byte(imx585, IMX585_REG_MODE_SELECT, IMX585_MODE_STANDBY);
 	if (ret)
 		dev_err(&client->dev, "%s failed to set stream\n", __func__);
 }
 
+/* Triggered frames are not periodic, so nothing to estimate */
+static void imx585_frame_timer_start(struct imx585 *imx585)
+{
+	if (imx585->sync_mode->val == IMX585_SYNC_TRIGGER)
+		return;
+
+	hrtimer_start(&imx585->frame_timer,
+		      ns_to_ktime(imx585_frame_period_ns(imx585)),
+		      HRTIMER_MODE_REL);
+}
+
+/* Start streaming */
+static int imx585_start_streaming(struct imx585 *imx585)
+{
+	ktime_t start;
+	int ret;
+
+	/* Staged sensors only have to leave standby */
+	if (!imx585->staged) {
+		ret = imx585_program(imx585);
+		if (ret)
+			return ret;
+	}
+	imx585->staged = false;
+
+	start = ktime_get();
+	ret = imx585_leave_standby(imx585);
+	if (ret)
+		return ret;
+	imx585_phase_done(imx585, IMX585_PHASE_STANDBY_EXIT, start);
+
+	/*
+	 * Frame starts come from XVS when it is wired up, otherwise they are
+	 * estimated.
+	 */
+	atomic_set(&imx585->frame_sequence, 0);
+	imx585->latched_exposure_ns = imx585_exposure_ns(imx585);
+	memset(imx585->stats, 0, sizeof(imx585->stats));
+
+	if (imx585->xvs_gpio) {
+		enable_irq(imx585->xvs_irq);
+		imx585->xvs_irq_enabled = true;
+	} else {
+		imx585_frame_timer_start(imx585);
+	}
+
+	if (imx585->timelapse->val)
+		imx585_timelapse_kick(imx585);
+
+	return 0;
+}
+
+/* Stop streaming */
+static void imx585_stop_streaming(struct imx585 *imx585)
+{
+	if (imx585->xvs_irq_enabled) {
+		disable_irq(imx585->xvs_irq);
+		imx585->xvs_irq_enabled = false;
+	}
+
+	/* Queued entries do not carry over to the next stream */
+	hrtimer_cancel(&imx585->frame_timer);
+	kfifo_reset(&imx585->frame_queue);
+
+	if (imx585->flash_gpio)
+		imx585_flash_set_mode(imx585, imx585->flash_mode->val);
+
+	cancel_delayed_work(&imx585->timelapse_work);
+	imx585->timelapse_standby = false;
+
+	imx585_enter_standby(imx585);
+}
+
+/*
+ * Timelapse cycle: queued by imx585_frame_start() at the last capture
+ * frame, stop the frame timer and go to standby once it is read out, then
+ * wake in time for the next capture.
+ */
+static void imx585_timelapse_work(struct work_struct *work)
+{
+	struct imx585 *imx585 = container_of(to_delayed_work(work),
+					     struct imx585, timelapse_work);
+	u64 interval_ns, now, wake;
+	unsigned long flags;
+
+	mutex_lock(&imx585->mutex);
+
+	if (!imx585->streaming)
+		goto out;
+
+	interval_ns = (u64)imx585->timelapse->val * NSEC_PER_MSEC;
+
+	if (imx585->timelapse_standby) {
+		spin_lock_irqsave(&imx585->timing_lock, flags);
+		imx585->timing_resync = true;
+		spin_unlock_irqrestore(&imx585->timing_lock, flags);
+
+		/* Due for a capture, or timelapse turned off */
+		if (imx585_leave_standby(imx585))
+			goto out;
+		imx585->timelapse_standby = false;
+		if (!imx585->xvs_gpio)
+			imx585_frame_timer_start(imx585);
+
+		if (interval_ns)
+			imx585_timelapse_count(imx585);
+	} else if (interval_ns) {
+		/* Let the last frame finish, standby would cut it short */
+		spin_lock_irqsave(&imx585->timing_lock, flags);
+		wake = imx585->timelapse_readout_end;
+		spin_unlock_irqrestore(&imx585->timing_lock, flags);
+		now = ktime_get_ns();
+		if ((s64)(wake - now) > 0)
+			usleep_range(div_u64(wake - now, NSEC_PER_USEC),
+				     div_u64(wake - now, NSEC_PER_USEC) + 100);
+
+		hrtimer_cancel(&imx585->frame_timer);
+		imx585_enter_standby(imx585);
+		imx585->timelapse_standby = true;
+
+		/* Skip captures that are already too late to make */
+		now = ktime_get_ns();
+		imx585->timelapse_next += interval_ns;
+		wake = imx585->timelapse_next -
+		       IMX585_STANDBY_EXIT_DELAY_US * NSEC_PER_USEC;
+		if ((s64)(wake - now) < 0) {
+			wake = now;
+			imx585->timelapse_next =
+				now + IMX585_STANDBY_EXIT_DELAY_US * NSEC_PER_USEC;
+		}
+
+		queue_delayed_work(system_wq, &imx585->timelapse_work,
+				   nsecs_to_jiffies(wake - now));
+	}
+out:
+	mutex_unlock(&imx585->mutex);
+}
+
 static int imx585_set_stream(struct v4l2_subdev *sd, int enable)
 {
 	struct imx585 *imx585 = to_imx585(sd);
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
 	int ret = 0;
 
+	/* Wait for a staged bring-up, it takes the mutex itself */
+	if (enable)
+		flush_work(&imx585->stage_work);
+
 	mutex_lock(&imx585->mutex);
 	if (imx585->streaming == enable) {
 		mutex_unlock(&imx585->mutex);
@@ -1127,11 +2577,17 @@ static int imx585_set_stream(struct v4l2_subdev *sd, int enable)
 	}
 
 	if (enable) {
+		ktime_t start = ktime_get();
+		bool powered = pm_runtime_active(&client->dev);
+
 		ret = pm_runtime_get_sync(&client->dev);
 		if (ret < 0) {
 			pm_runtime_put_noidle(&client->dev);
 			goto err_unlock;
 		}
+		/* Already counted by imx585_stage_work() if staged */
+		if (!powered)
+			imx585_phase_done(imx585, IMX585_PHASE_POWER_ON, start);
 
 		/*
 		 * Apply default & customized values
@@ -1142,13 +2598,36 @@ static int imx585_set_stream(struct v4l2_subdev *sd, int enable)
 			goto err_rpm_put;
 	} else {
 		imx585_stop_streaming(imx585);
-		pm_runtime_put(&client->dev);
+		pm_runtime_mark_last_busy(&client->dev);
+		pm_runtime_put_autosuspend(&client->dev);
 	}
 
 	imx585->streaming = enable;
 
+	/* Throttling starts afresh with each stream, undo it at stream off */
+	if (!enable && imx585->thermal_throttled) {
+		imx585->thermal_update = true;
+		__v4l2_ctrl_s_ctrl(imx585->vblank, imx585->thermal_vblank);
+		imx585->thermal_update = false;
+	}
+	imx585->thermal_throttled = false;
+
+	/* The governor work exits by itself once streaming is cleared */
+	if (imx585->thermal_limit) {
+		if (enable)
+			queue_delayed_work(system_wq, &imx585->thermal_work,
+					   msecs_to_jiffies(IMX585_THERMAL_INTERVAL_MS));
+		else
+			cancel_delayed_work(&imx585->thermal_work);
+	}
+
 	/* vflip and hflip cannot change during streaming */
 	__v4l2_ctrl_grab(imx585->vflip, enable);
+	__v4l2_ctrl_grab(imx585->hflip, enable);
+	/* nor can the sync role */
+	__v4l2_ctrl_grab(imx585->sync_mode, enable);
+	/* nor the link frequency */
+	__v4l2_ctrl_grab(imx585->power_profile, enable);
 
 	mutex_unlock(&imx585->mutex);
 
@@ -1162,6 +2641,34 @@ err_unlock:
 	return ret;
 }
 
+/* Verify chip ID */
+static int imx585_identify_module(struct imx585 *imx585, u32 expected_id)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
+	int ret;
+	u32 val;
+
+	ret = imx585_read_reg(imx585, IMX585_REG_CHIP_ID,
+			      1, &val);
+	if (ret) {
+		dev_err(&client->dev, "failed to read chip id %x, with error %d\n",
+			expected_id, ret);
+		return ret;
+	}
+
+	/* Only a reset value if XCLR or the supply was actually cycled */
+	if (imx585->regs_at_reset && val != expected_id) {
+		dev_err(&client->dev, "chip id mismatch: %x!=%x\n",
+			expected_id, val);
+		return -ENODEV;
+	}
+
+	dev_info(&client->dev, "Device found, %s\n",
+		 imx585->compatible_data->name);
+
+	return 0;
+}
+
 /* Power/clock management functions */
 static int imx585_power_on(struct device *dev)
 {
@@ -1170,6 +2677,9 @@ static int imx585_power_on(struct device *dev)
 	struct imx585 *imx585 = to_imx585(sd);
 	int ret;
 
+	imx585->regs_at_reset = imx585->reset_gpio ||
+		!regulator_is_enabled(imx585->supplies[0].consumer);
+
 	ret = regulator_bulk_enable(imx585_NUM_SUPPLIES,
 				    imx585->supplies);
 	if (ret) {
@@ -1189,8 +2699,20 @@ static int imx585_power_on(struct device *dev)
 	usleep_range(imx585_XCLR_MIN_DELAY_US,
 		     imx585_XCLR_MIN_DELAY_US + imx585_XCLR_DELAY_RANGE_US);
 
+	/* At probe, or at first use with lazy_identify */
+	if (!imx585->identified) {
+		ret = imx585_identify_module(imx585,
+					     imx585->compatible_data->chip_id);
+		if (ret)
+			goto clk_off;
+		imx585->identified = true;
+	}
+
 	return 0;
 
+clk_off:
+	gpiod_set_value_cansleep(imx585->reset_gpio, 0);
+	clk_disable_unprepare(imx585->xclk);
 reg_off:
 	regulator_bulk_disable(imx585_NUM_SUPPLIES, imx585->supplies);
 	return ret;
@@ -1208,6 +2730,81 @@ static int imx585_power_off(struct device *dev)
 
 	/* Force reprogramming of the common registers when powered up again. */
 	imx585->common_regs_written = false;
+	imx585->staged = false;
+
+	return 0;
+}
+
+/*
+ * Registers written by controls rather than the tables. The first window
+ * spans flips, VMAX and HMAX along with the mode registers between them.
+ */
+static const struct {
+	u16 reg;
+	u8 len;
+} imx585_snapshot_windows[] = {
+	{ IMX585_REG_HFLIP, 14 },
+	{ IMX585_REG_SHR, 3 },
+	{ IMX585_REG_ANALOG_GAIN, 2 },
+	{ IMX585_REG_XXS_DRV, 1 },
+	{ IMX585_REG_BLKLEVEL, 2 },
+};
+
+static int imx585_snapshot_save(struct imx585 *imx585)
+{
+	unsigned int i, offset = 0;
+	int ret;
+
+	for (i = 0; i < ARRAY_SIZE(imx585_snapshot_windows); i++) {
+		ret = imx585_read_burst(imx585, imx585_snapshot_windows[i].reg,
+					&imx585->snapshot[offset],
+					imx585_snapshot_windows[i].len);
+		if (ret)
+			return ret;
+		offset += imx585_snapshot_windows[i].len;
+	}
+
+	return 0;
+}
+
+/*
+ * Reprogram the sensor in bursts from the tables and the snapshot, without
+ * replaying the control handler.
+ */
+static int imx585_snapshot_restore(struct imx585 *imx585)
+{
+	const struct IMX585_reg_list *reg_list = &imx585->mode->reg_list;
+	const struct IMX585_reg_list *extra_regs =
+		&imx585->compatible_data->extra_regs;
+	unsigned int i, offset = 0;
+	int ret;
+
+	ret = imx585_write_regs(imx585, mode_common_regs,
+				ARRAY_SIZE(mode_common_regs));
+	if (!ret)
+		ret = imx585_write_regs(imx585, extra_regs->regs,
+					extra_regs->num_of_regs);
+	if (ret)
+		return ret;
+	imx585->common_regs_written = true;
+
+	ret = imx585_write_reg_1byte(imx585, IMX585_REG_DATARATE_SEL,
+				     imx585_datarate_sel[imx585->data_rate]);
+	if (ret)
+		return ret;
+
+	ret = imx585_write_regs(imx585, reg_list->regs, reg_list->num_of_regs);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < ARRAY_SIZE(imx585_snapshot_windows); i++) {
+		ret = imx585_write_burst(imx585, imx585_snapshot_windows[i].reg,
+					 &imx585->snapshot[offset],
+					 imx585_snapshot_windows[i].len);
+		if (ret)
+			return ret;
+		offset += imx585_snapshot_windows[i].len;
+	}
 
 	return 0;
 }
@@ -1218,10 +2815,23 @@ static int __maybe_unused imx585_suspend(struct device *dev)
 	struct v4l2_subdev *sd = i2c_get_clientdata(client);
 	struct imx585 *imx585 = to_imx585(sd);
 
-	if (imx585->streaming)
+	/* streaming stays set, so the works would not exit by themselves */
+	cancel_delayed_work_sync(&imx585->timelapse_work);
+	cancel_delayed_work_sync(&imx585->thermal_work);
+	cancel_work_sync(&imx585->frame_work);
+
+	mutex_lock(&imx585->mutex);
+	if (imx585->streaming) {
 		imx585_stop_streaming(imx585);
+		imx585->snapshot_valid = !imx585_snapshot_save(imx585);
+	}
+	mutex_unlock(&imx585->mutex);
 
-	return 0;
+	/* A frame start before stop_streaming may have queued it again */
+	cancel_delayed_work_sync(&imx585->timelapse_work);
+
+	/* Power down, the snapshot and tables bring it back */
+	return pm_runtime_force_suspend(dev);
 }
 
 static int __maybe_unused imx585_resume(struct device *dev)
@@ -1229,22 +2839,97 @@ static int __maybe_unused imx585_resume(struct device *dev)
 	struct i2c_client *client = to_i2c_client(dev);
 	struct v4l2_subdev *sd = i2c_get_clientdata(client);
 	struct imx585 *imx585 = to_imx585(sd);
+	ktime_t start = ktime_get();
 	int ret;
 
+	/* Powers the sensor up again if it is streaming */
+	ret = pm_runtime_force_resume(dev);
+	if (ret)
+		return ret;
+
+	mutex_lock(&imx585->mutex);
 	if (imx585->streaming) {
+		/* Fall back to full programming if the snapshot is unusable */
+		if (imx585->snapshot_valid &&
+		    !imx585_snapshot_restore(imx585))
+			imx585->staged = true;
+		imx585->snapshot_valid = false;
+
+		/* Restart the timelapse cycle with a capture */
+		imx585->timelapse_standby = false;
+
 		ret = imx585_start_streaming(imx585);
 		if (ret)
 			goto error;
+
+		if (imx585->thermal_limit)
+			queue_delayed_work(system_wq, &imx585->thermal_work,
+					   msecs_to_jiffies(IMX585_THERMAL_INTERVAL_MS));
+
+		imx585_phase_done(imx585, IMX585_PHASE_RESUME, start);
 	}
+	mutex_unlock(&imx585->mutex);
 
 	return 0;
 
 error:
 	imx585_stop_streaming(imx585);
 	imx585->streaming = 0;
+	mutex_unlock(&imx585->mutex);
+	pm_runtime_put(&client->dev);
 	return ret;
 }
 
+static const char * const imx585_phase_names[IMX585_NUM_PHASES] = {
+	[IMX585_PHASE_POWER_ON] = "power_on",
+	[IMX585_PHASE_COMMON_REGS] = "common_regs",
+	[IMX585_PHASE_MODE_REGS] = "mode_regs",
+	[IMX585_PHASE_CTRL_SETUP] = "ctrl_setup",
+	[IMX585_PHASE_STANDBY_EXIT] = "standby_exit",
+	[IMX585_PHASE_RESUME] = "resume",
+};
+
+static int imx585_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Percentiles over the last IMX585_PHASE_SAMPLES of each phase, in us */
+static int imx585_stream_timing_show(struct seq_file *m, void *unused)
+{
+	struct imx585 *imx585 = m->private;
+	u32 sorted[IMX585_PHASE_SAMPLES];
+	unsigned int i, n, last;
+
+	seq_puts(m, "phase         count     last      p50      p90      p99      max\n");
+
+	mutex_lock(&imx585->mutex);
+	for (i = 0; i < IMX585_NUM_PHASES; i++) {
+		n = min_t(unsigned int, imx585->phase_count[i],
+			  IMX585_PHASE_SAMPLES);
+		if (!n) {
+			seq_printf(m, "%-12s %6u\n", imx585_phase_names[i], 0);
+			continue;
+		}
+
+		last = (imx585->phase_count[i] - 1) % IMX585_PHASE_SAMPLES;
+		memcpy(sorted, imx585->phase_us[i], n * sizeof(*sorted));
+		sort(sorted, n, sizeof(*sorted), imx585_cmp_u32, NULL);
+
+		seq_printf(m, "%-12s %6u %8u %8u %8u %8u %8u\n",
+			   imx585_phase_names[i], imx585->phase_count[i],
+			   imx585->phase_us[i][last],
+			   sorted[(n - 1) * 50 / 100], sorted[(n - 1) * 90 / 100],
+			   sorted[(n - 1) * 99 / 100], sorted[n - 1]);
+	}
+	mutex_unlock(&imx585->mutex);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(imx585_stream_timing);
+
 static int imx585_get_regulators(struct imx585 *imx585)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
@@ -1258,26 +2943,6 @@ static int imx585_get_regulators(struct imx585 *imx585)
 				       imx585->supplies);
 }
 
-/* Verify chip ID */
-static int imx585_identify_module(struct imx585 *imx585, u32 expected_id)
-{
-	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
-	int ret;
-	u32 val;
-
-	ret = imx585_read_reg(imx585, IMX585_REG_CHIP_ID,
-			      1, &val);
-	if (ret) {
-		dev_err(&client->dev, "failed to read chip id %x, with error %d\n",
-			expected_id, ret);
-		return ret;
-	}
-
-	dev_info(&client->dev, "Device found\n");
-
-	return 0;
-}
-
 static int imx585_get_selection(struct v4l2_subdev *sd,
 				struct v4l2_subdev_state *sd_state,
 				struct v4l2_subdev_selection *sel)
@@ -1316,8 +2981,24 @@ static int imx585_get_selection(struct v4l2_subdev *sd,
 }
 
 
+static int imx585_subscribe_event(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+				  struct v4l2_event_subscription *sub)
+{
+	struct imx585 *imx585 = to_imx585(sd);
+
+	switch (sub->type) {
+	case V4L2_EVENT_FRAME_SYNC:
+		/* Only raised from the XVS interrupt */
+		if (!imx585->xvs_gpio)
+			return -EINVAL;
+		return v4l2_event_subscribe(fh, sub, 2, NULL);
+	default:
+		return v4l2_ctrl_subdev_subscribe_event(sd, fh, sub);
+	}
+}
+
 static const struct v4l2_subdev_core_ops imx585_core_ops = {
-	.subscribe_event = v4l2_ctrl_subdev_subscribe_event,
+	.subscribe_event = imx585_subscribe_event,
 	.unsubscribe_event = v4l2_event_subdev_unsubscribe,
 };
 
@@ -1325,12 +3006,55 @@ static const struct v4l2_subdev_video_ops imx585_video_ops = {
 	.s_stream = imx585_set_stream,
 };
 
+/*
+ * Both pads go out on virtual channel 0 and are told apart by data type,
+ * so a receiver can demux image and embedded data from one stream. Entry
+ * streams are the pad numbers.
+ */
+static int imx585_get_frame_desc(struct v4l2_subdev *sd, unsigned int pad,
+				 struct v4l2_mbus_frame_desc *fd)
+{
+	struct imx585 *imx585 = to_imx585(sd);
+	const struct imx585_mode *mode;
+
+	if (pad >= NUM_PADS)
+		return -EINVAL;
+
+	mutex_lock(&imx585->mutex);
+	mode = imx585->mode;
+
+	memset(fd, 0, sizeof(*fd));
+	fd->type = V4L2_MBUS_FRAME_DESC_TYPE_CSI2;
+
+	/*
+	 * Embedded data is never enabled (see IMX585_EMBEDDED_BPP), so the
+	 * metadata pad has no stream on the bus.
+	 */
+	if (pad == METADATA_PAD)
+		goto out;
+
+	fd->num_entries = 1;
+	fd->entry[0].stream = IMAGE_PAD;
+	fd->entry[0].pixelcode =
+		imx585_get_format_code(imx585, imx585->fmt_code);
+	fd->entry[0].length = mode->width * mode->height * IMX585_BPP / 8;
+	fd->entry[0].flags = V4L2_MBUS_FRAME_DESC_FL_LEN_MAX;
+	fd->entry[0].bus.csi2.vc = 0;
+	fd->entry[0].bus.csi2.dt = MIPI_CSI2_DT_RAW12;
+
+out:
+	mutex_unlock(&imx585->mutex);
+
+	return 0;
+}
+
 static const struct v4l2_subdev_pad_ops imx585_pad_ops = {
 	.enum_mbus_code = imx585_enum_mbus_code,
 	.get_fmt = imx585_get_pad_format,
 	.set_fmt = imx585_set_pad_format,
 	.get_selection = imx585_get_selection,
 	.enum_frame_size = imx585_enum_frame_size,
+	.get_frame_desc = imx585_get_frame_desc,
 };
 
 static const struct v4l2_subdev_ops imx585_subdev_ops = {
@@ -1352,6 +3076,9 @@ static int imx585_init_controls(struct imx585 *imx585)
 	struct v4l2_ctrl_handler *ctrl_hdlr;
 	struct i2c_client *client = v4l2_get_subdevdata(&imx585->sd);
 	struct v4l2_fwnode_device_properties props;
+	struct v4l2_ctrl_config sync_mode_ctrl;
+	unsigned int i;
+	u32 sync_mode;
 	int ret;
 
 	ctrl_hdlr = &imx585->ctrl_handler;
@@ -1381,6 +3108,10 @@ static int imx585_init_controls(struct imx585 *imx585)
 
 	imx585->link_freq->flags |= V4L2_CTRL_FLAG_READ_ONLY;
 
+	imx585->power_profile = v4l2_ctrl_new_custom(ctrl_hdlr,
+						     &imx585_power_profile_ctrl,
+						     NULL);
+
 
 	imx585->vblank = v4l2_ctrl_new_std(ctrl_hdlr, &imx585_ctrl_ops,
 					   V4L2_CID_VBLANK, 0, 0xfffff, 1, 0);
@@ -1394,16 +3125,89 @@ static int imx585_init_controls(struct imx585 *imx585)
 					     IMX585_EXPOSURE_STEP,
 					     IMX585_EXPOSURE_DEFAULT);
 
-	v4l2_ctrl_new_std(ctrl_hdlr, &imx585_ctrl_ops, V4L2_CID_ANALOGUE_GAIN,
-			  IMX585_ANA_GAIN_MIN, IMX585_ANA_GAIN_MAX,
-			  IMX585_ANA_GAIN_STEP, IMX585_ANA_GAIN_DEFAULT);
+	imx585->gain = v4l2_ctrl_new_std(ctrl_hdlr, &imx585_ctrl_ops,
+					 V4L2_CID_ANALOGUE_GAIN,
+					 IMX585_ANA_GAIN_MIN,
+					 IMX585_ANA_GAIN_MAX,
+					 IMX585_ANA_GAIN_STEP,
+					 IMX585_ANA_GAIN_DEFAULT);
+
+	imx585->digital_gain = v4l2_ctrl_new_std(ctrl_hdlr, &imx585_ctrl_ops,
+						 V4L2_CID_DIGITAL_GAIN,
+						 IMX585_DGTL_GAIN_MIN,
+						 IMX585_DGTL_GAIN_MAX,
+						 IMX585_DGTL_GAIN_STEP,
+						 IMX585_DGTL_GAIN_DEFAULT);
+
+	v4l2_ctrl_new_custom(ctrl_hdlr, &imx585_black_level_ctrl, NULL);
+
+	/* The sync role defaults to the "sony,sync-mode" DT property */
+	sync_mode = IMX585_SYNC_MASTER;
+	device_property_read_u32(&client->dev, "sony,sync-mode", &sync_mode);
+	if (sync_mode > IMX585_SYNC_TRIGGER) {
+		dev_warn(&client->dev, "invalid sync mode %u, using master\n",
+			 sync_mode);
+		sync_mode = IMX585_SYNC_MASTER;
+	}
+
+	sync_mode_ctrl = imx585_sync_mode_ctrl;
+	sync_mode_ctrl.def = sync_mode;
+	imx585->sync_mode = v4l2_ctrl_new_custom(ctrl_hdlr, &sync_mode_ctrl,
+						 NULL);
+
 
+	imx585->hflip = v4l2_ctrl_new_std(ctrl_hdlr, &imx585_ctrl_ops,
+					  V4L2_CID_HFLIP, 0, 1, 1, 0);
+	if (imx585->hflip)
+		imx585->hflip->flags |= V4L2_CTRL_FLAG_MODIFY_LAYOUT;
 
 	imx585->vflip = v4l2_ctrl_new_std(ctrl_hdlr, &imx585_ctrl_ops,
 					  V4L2_CID_VFLIP, 0, 1, 1, 0);
 	if (imx585->vflip)
 		imx585->vflip->flags |= V4L2_CTRL_FLAG_MODIFY_LAYOUT;
 
+	v4l2_ctrl_new_custom(ctrl_hdlr, &imx585_frame_queue_ctrl, NULL);
+
+	v4l2_ctrl_new_custom(ctrl_hdlr, &imx585_frame_timing_ctrl, NULL);
+	v4l2_ctrl_new_custom(ctrl_hdlr, &imx585_frame_stats_ctrl, NULL);
+	imx585->timelapse = v4l2_ctrl_new_custom(ctrl_hdlr,
+						 &imx585_timelapse_ctrl, NULL);
+
+	if (imx585->temp_chan) {
+		v4l2_ctrl_new_custom(ctrl_hdlr, &imx585_temperature_ctrl, NULL);
+		imx585->thermal_limit =
+			v4l2_ctrl_new_custom(ctrl_hdlr,
+					     &imx585_thermal_limit_ctrl, NULL);
+	}
+
+	/*
+	 * Pulses are timed from the XVS edge. The hrtimer estimate drifts
+	 * against the sensor clock, so without XVS only torch is offered.
+	 */
+	if (imx585->flash_gpio) {
+		imx585->flash_mode =
+			v4l2_ctrl_new_std_menu(ctrl_hdlr, &imx585_ctrl_ops,
+					       V4L2_CID_FLASH_LED_MODE,
+					       V4L2_FLASH_LED_MODE_TORCH,
+					       imx585->xvs_gpio ? 0 :
+					       BIT(V4L2_FLASH_LED_MODE_FLASH),
+					       V4L2_FLASH_LED_MODE_NONE);
+		if (imx585->xvs_gpio)
+			imx585->flash_timeout =
+				v4l2_ctrl_new_std(ctrl_hdlr, &imx585_ctrl_ops,
+						  V4L2_CID_FLASH_TIMEOUT,
+						  IMX585_FLASH_TIMEOUT_MIN,
+						  IMX585_FLASH_TIMEOUT_MAX,
+						  IMX585_FLASH_TIMEOUT_STEP,
+						  IMX585_FLASH_TIMEOUT_MAX);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(imx585_delay_ctrls); i++)
+		v4l2_ctrl_new_custom(ctrl_hdlr, &imx585_delay_ctrls[i], NULL);
+
+	/* One s_ctrl call and one register hold per AE update */
+	v4l2_ctrl_cluster(4, &imx585->vblank);
+
 	if (ctrl_hdlr->error) {
 		ret = ctrl_hdlr->error;
 		dev_err(&client->dev, "%s control init failed (%d)\n",
@@ -1443,6 +3247,17 @@ static void imx585_free_controls(struct imx585 *imx585)
 
 static const struct imx585_compatible_data imx585_compatible = {
 	.chip_id = IMX585_CHIP_ID,
+	.name = "IMX585-AAQJ1 (colour)",
+	.extra_regs = {
+		.num_of_regs = 0,
+		.regs = NULL
+	}
+};
+
+static const struct imx585_compatible_data imx585_mono_compatible = {
+	.chip_id = IMX585_CHIP_ID,
+	.mono = true,
+	.name = "IMX585-AAMJ1 (mono)",
 	.extra_regs = {
 		.num_of_regs = 0,
 		.regs = NULL
@@ -1451,6 +3266,7 @@ static const struct imx585_compatible_data imx585_compatible = {
 
 static const struct of_device_id imx585_dt_ids[] = {
 	{ .compatible = "sony,imx585", .data = &imx585_compatible },
+	{ .compatible = "sony,imx585-mono", .data = &imx585_mono_compatible },
 	{ /* sentinel */ }
 };
 
@@ -1459,6 +3275,7 @@ static int imx585_probe(struct i2c_client *client)
 	struct device *dev = &client->dev;
 	struct imx585 *imx585;
 	const struct of_device_id *match;
+	char debugfs_name[32];
 	int ret;
 
 	imx585 = devm_kzalloc(&client->dev, sizeof(*imx585), GFP_KERNEL);
@@ -1493,27 +3310,94 @@ static int imx585_probe(struct i2c_client *client)
 		return ret;
 	}
 
-	/* Request optional enable pin */
+	/*
+	 * Request optional enable pin, holding XCLR low until
+	 * imx585_power_on() has the rails up
+	 */
 	imx585->reset_gpio = devm_gpiod_get_optional(dev, "reset",
-						     GPIOD_OUT_HIGH);
+						     GPIOD_OUT_LOW);
+
+	/* Request optional XVS input for frame start interrupts */
+	imx585->xvs_gpio = devm_gpiod_get_optional(dev, "xvs", GPIOD_IN);
+	if (IS_ERR(imx585->xvs_gpio)) {
+		dev_err(dev, "failed to get xvs gpio\n");
+		return PTR_ERR(imx585->xvs_gpio);
+	}
+
+	/* Request optional flash output, it is driven from an hrtimer */
+	imx585->flash_gpio = devm_gpiod_get_optional(dev, "flash",
+						     GPIOD_OUT_LOW);
+	if (IS_ERR(imx585->flash_gpio)) {
+		dev_err(dev, "failed to get flash gpio\n");
+		return PTR_ERR(imx585->flash_gpio);
+	}
+	if (imx585->flash_gpio && gpiod_cansleep(imx585->flash_gpio)) {
+		dev_err(dev, "flash gpio must not sleep\n");
+		return -EINVAL;
+	}
+
+	/* Request optional temperature channel, io-channel-names "temperature" */
+	imx585->temp_chan = devm_iio_channel_get(dev, "temperature");
+	if (IS_ERR(imx585->temp_chan)) {
+		ret = PTR_ERR(imx585->temp_chan);
+		if (ret != -ENODEV) {
+			dev_err(dev, "failed to get temperature channel\n");
+			return ret;
+		}
+		imx585->temp_chan = NULL;
+	}
 	
 	/*
-	 * The sensor must be powered for imx585_identify_module()
-	 * to be able to read the CHIP_ID register
+	 * Powering up reads the CHIP_ID register through
+	 * imx585_identify_module(). With lazy_identify that waits for the
+	 * first use instead of holding up boot.
 	 */
-	ret = imx585_power_on(dev);
-	if (ret)
-		return ret;
-
-	ret = imx585_identify_module(imx585, imx585->compatible_data->chip_id);
-	if (ret)
-		goto error_power_off;
+	if (!lazy_identify) {
+		ret = imx585_power_on(dev);
+		if (ret)
+			return ret;
+	}
 
 	/* Initialize default format */
 	imx585_set_default_format(imx585);
 
+	INIT_KFIFO(imx585->frame_queue);
+	spin_lock_init(&imx585->timing_lock);
+	hrtimer_init(&imx585->frame_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	imx585->frame_timer.function = imx585_frame_timer_fn;
+	hrtimer_init(&imx585->flash_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	imx585->flash_timer.function = imx585_flash_timer_fn;
+	INIT_WORK(&imx585->frame_work, imx585_frame_work);
+	INIT_WORK(&imx585->stage_work, imx585_stage_work);
+	INIT_DELAYED_WORK(&imx585->thermal_work, imx585_thermal_work);
+	INIT_DELAYED_WORK(&imx585->timelapse_work, imx585_timelapse_work);
+
+	/* XVS is active low, the IRQ is only enabled while streaming */
+	if (imx585->xvs_gpio) {
+		imx585->xvs_irq = gpiod_to_irq(imx585->xvs_gpio);
+		if (imx585->xvs_irq < 0) {
+			ret = imx585->xvs_irq;
+			dev_err(dev, "failed to get xvs irq: %d\n", ret);
+			goto error_power_off;
+		}
+
+		ret = devm_request_threaded_irq(dev, imx585->xvs_irq,
+						imx585_xvs_irq,
+						imx585_xvs_irq_thread,
+						IRQF_TRIGGER_FALLING |
+						IRQF_ONESHOT | IRQF_NO_AUTOEN,
+						dev_name(dev), imx585);
+		if (ret) {
+			dev_err(dev, "failed to request xvs irq: %d\n", ret);
+			goto error_power_off;
+		}
+	}
+
 	/* Enable runtime PM and turn off the device */
-	pm_runtime_set_active(dev);
+	if (!lazy_identify)
+		pm_runtime_set_active(dev);
+	pm_runtime_set_autosuspend_delay(dev, IMX585_AUTOSUSPEND_DELAY_MS);
+	pm_runtime_use_autosuspend(dev);
 	pm_runtime_enable(dev);
 	pm_runtime_idle(dev);
 
@@ -1544,6 +3428,12 @@ static int imx585_probe(struct i2c_client *client)
 		goto error_media_entity;
 	}
 
+	/* e.g. imx585-10-001a, one per sensor */
+	snprintf(debugfs_name, sizeof(debugfs_name), "imx585-%s", dev_name(dev));
+	imx585->debugfs = debugfs_create_dir(debugfs_name, NULL);
+	debugfs_create_file("stream_timing", 0444, imx585->debugfs, imx585,
+			    &imx585_stream_timing_fops);
+
 	return 0;
 
 error_media_entity:
@@ -1554,8 +3444,10 @@ error_handler_free:
 
 error_power_off:
 	pm_runtime_disable(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
 	pm_runtime_set_suspended(&client->dev);
-	imx585_power_off(&client->dev);
+	if (!lazy_identify)
+		imx585_power_off(&client->dev);
 
 	return ret;
 }
@@ -1565,11 +3457,25 @@ static void imx585_remove(struct i2c_client *client)
 	struct v4l2_subdev *sd = i2c_get_clientdata(client);
 	struct imx585 *imx585 = to_imx585(sd);
 
+	debugfs_remove_recursive(imx585->debugfs);
+
 	v4l2_async_unregister_subdev(sd);
 	media_entity_cleanup(&sd->entity);
+
+	hrtimer_cancel(&imx585->frame_timer);
+	cancel_work_sync(&imx585->frame_work);
+	hrtimer_cancel(&imx585->flash_timer);
+
+	cancel_work_sync(&imx585->stage_work);
+	cancel_delayed_work_sync(&imx585->thermal_work);
+	cancel_delayed_work_sync(&imx585->timelapse_work);
+	if (imx585->flash_gpio)
+		gpiod_set_value(imx585->flash_gpio, 0);
+
 	imx585_free_controls(imx585);
 
 	pm_runtime_disable(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
 	if (!pm_runtime_status_suspended(&client->dev))
 		imx585_power_off(&client->dev);
 	pm_runtime_set_suspended(&client->dev);
@@ -1588,6 +3494,7 @@ static struct i2c_driver imx585_i2c_driver = {
 		.name = "imx585",
 		.of_match_table	= imx585_dt_ids,
 		.pm = &imx585_pm_ops,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe = imx585_probe,
 	.remove = imx585_remove,
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Parser for IMX585 embedded data lines.
+ *
+ * The line is first unpacked into payload bytes, dropping the bytes that
+ * hold the packed low bits (every third in RAW12, every fifth in RAW10).
+ * That is the bulk of the work and runs on NEON where available. The tag
+ * walk that follows stops at the end marker, which comes early in the line.
+ */
+#include <errno.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "imx585_md.h"
+
+#define IMX585_MD_LINE_START	0x0A
+#define IMX585_MD_TAG_ADDR_HI	0xAA
+#define IMX585_MD_TAG_ADDR_LO	0xA5
+#define IMX585_MD_TAG_VALUE	0x5A
+#define IMX585_MD_TAG_SKIP	0x55
+#define IMX585_MD_TAG_END	0x07
+
+/* Registers read by imx585_md_frame(), as in the driver */
+#define IMX585_MD_REG_VMAX	0x3028
+#define IMX585_MD_REG_HMAX	0x302C
+#define IMX585_MD_REG_SHR	0x3050
+#define IMX585_MD_REG_GAIN	0x306C
+
+/* Drop every third byte, returns the payload length */
+static size_t unpack_raw12(uint8_t *out, const uint8_t *in, size_t len)
+{
+	size_t i = 0, o = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	for (; i + 48 <= len; i += 48, o += 32) {
+		uint8x16x3_t v = vld3q_u8(in + i);
+		uint8x16x2_t w = { { v.val[0], v.val[1] } };
+
+		vst2q_u8(out + o, w);
+	}
+#endif
+
+	for (; i + 3 <= len; i += 3, o += 2) {
+		out[o] = in[i];
+		out[o + 1] = in[i + 1];
+	}
+
+	return o;
+}
+
+/* Drop every fifth byte, returns the payload length */
+static size_t unpack_raw10(uint8_t *out, const uint8_t *in, size_t len)
+{
+	size_t i = 0, o = 0;
+
+	for (; i + 5 <= len; i += 5, o += 4)
+		memcpy(out + o, in + i, 4);
+
+	return o;
+}
+
+static void set_reg(struct imx585_md *md, unsigned int addr, uint8_t val)
+{
+	unsigned int i;
+
+	if (addr < IMX585_MD_REG_BASE ||
+	    addr >= IMX585_MD_REG_BASE + IMX585_MD_REG_COUNT)
+		return;
+
+	i = addr - IMX585_MD_REG_BASE;
+	md->regs[i] = val;
+	md->valid[i / 8] |= 1u << (i % 8);
+}
+
+int imx585_md_parse(struct imx585_md *md, const uint8_t *line, size_t width,
+		    unsigned int bpp)
+{
+	unsigned int addr = 0;
+	size_t len, i;
+
+	if (!md || !line)
+		return -EINVAL;
+
+	switch (bpp) {
+	case 12:
+		if (width / 3 * 2 > IMX585_MD_MAX_PAYLOAD)
+			return -EINVAL;
+		len = unpack_raw12(md->payload, line, width);
+		break;
+	case 10:
+		if (width / 5 * 4 > IMX585_MD_MAX_PAYLOAD)
+			return -EINVAL;
+		len = unpack_raw10(md->payload, line, width);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	memset(md->valid, 0, sizeof(md->valid));
+
+	if (!len || md->payload[0] != IMX585_MD_LINE_START)
+		return -ENODATA;
+
+	for (i = 1; i + 1 < len; i += 2) {
+		uint8_t tag = md->payload[i];
+		uint8_t byte = md->payload[i + 1];
+
+		switch (tag) {
+		case IMX585_MD_TAG_ADDR_HI:
+			addr = (addr & 0x00ff) | (byte << 8);
+			break;
+		case IMX585_MD_TAG_ADDR_LO:
+			addr = (addr & 0xff00) | byte;
+			break;
+		case IMX585_MD_TAG_VALUE:
+			set_reg(md, addr++, byte);
+			break;
+		case IMX585_MD_TAG_SKIP:
+			addr++;
+			break;
+		case IMX585_MD_TAG_END:
+		default:
+			/* Anything else is padding after the last tag */
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+int imx585_md_reg(const struct imx585_md *md, uint16_t addr, unsigned int len,
+		  uint32_t *val)
+{
+	uint32_t v = 0;
+	unsigned int i, r;
+
+	if (!md || !val || !len || len > 4)
+		return -EINVAL;
+
+	for (i = 0; i < len; i++) {
+		if (addr + i < IMX585_MD_REG_BASE ||
+		    addr + i >= IMX585_MD_REG_BASE + IMX585_MD_REG_COUNT)
+			return -ENOENT;
+
+		r = addr + i - IMX585_MD_REG_BASE;
+		if (!(md->valid[r / 8] & (1u << (r % 8))))
+			return -ENOENT;
+
+		v |= (uint32_t)md->regs[r] << (8 * i);
+	}
+
+	*val = v;
+
+	return 0;
+}
+
+int imx585_md_frame(const struct imx585_md *md, struct imx585_md_frame *frame)
+{
+	int ret;
+
+	if (!frame)
+		return -EINVAL;
+
+	ret = imx585_md_reg(md, IMX585_MD_REG_VMAX, 3, &frame->vmax);
+	if (!ret)
+		ret = imx585_md_reg(md, IMX585_MD_REG_HMAX, 2, &frame->hmax);
+	if (!ret)
+		ret = imx585_md_reg(md, IMX585_MD_REG_SHR, 3, &frame->shr);
+	if (!ret)
+		ret = imx585_md_reg(md, IMX585_MD_REG_GAIN, 2, &frame->gain);
+	if (ret)
+		return ret;
+
+	frame->vmax &= 0xfffff;
+	frame->shr &= 0xfffff;
+	frame->gain &= 0x7ff;
+	frame->exposure = frame->vmax > frame->shr ?
+			  frame->vmax - frame->shr : 0;
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Parser for IMX585 embedded data lines.
+ *
+ * The driver documents the line layout next to IMX585_NUM_EMBEDDED_LINES:
+ * a 0x0A format code followed by tag/byte pairs (0xAA/0xA5 register
+ * address, 0x5A value, 0x55 skip, 0x07 end), packed at the image bit depth.
+ * That is the layout of other Sony sensors. The driver does not enable
+ * embedded data on the IMX585, so it is unverified there.
+ */
+#ifndef IMX585_MD_H
+#define IMX585_MD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Register window kept by the parser, covers the sensor's 0x3xxx map */
+#define IMX585_MD_REG_BASE	0x3000
+#define IMX585_MD_REG_COUNT	0x1000
+
+/* Longest payload, a 3856 pixel RAW12 line carries 3856 bytes */
+#define IMX585_MD_MAX_PAYLOAD	8192
+
+struct imx585_md {
+	uint8_t regs[IMX585_MD_REG_COUNT];
+	uint8_t valid[IMX585_MD_REG_COUNT / 8];
+	uint8_t payload[IMX585_MD_MAX_PAYLOAD];
+};
+
+/* Values applied to the frame the line was sent with */
+struct imx585_md_frame {
+	uint32_t vmax;
+	uint32_t hmax;
+	uint32_t shr;
+	/* VMAX - SHR, the exposure in lines as set through V4L2 */
+	uint32_t exposure;
+	/* GAIN register, 0.3 dB per code */
+	uint32_t gain;
+};
+
+/*
+ * Parse one embedded data line of width bytes, packed at bpp bits per
+ * pixel (10 or 12). Registers outside IMX585_MD_REG_BASE +
+ * IMX585_MD_REG_COUNT are ignored. Returns 0, -EINVAL on bad arguments or
+ * -ENODATA if the line does not start with the format code.
+ */
+int imx585_md_parse(struct imx585_md *md, const uint8_t *line, size_t width,
+		    unsigned int bpp);
+
+/*
+ * Read len (1 to 4) consecutive registers from the last parsed line,
+ * least significant byte first as the sensor stores them. Returns 0 or
+ * -ENOENT if any of them was not present in the line.
+ */
+int imx585_md_reg(const struct imx585_md *md, uint16_t addr, unsigned int len,
+		  uint32_t *val);
+
+/*
+ * Fill frame from the last parsed line. The frame counter and temperature
+ * registers are not in the documented map, read them with imx585_md_reg()
+ * once their addresses are known.
+ */
+int imx585_md_frame(const struct imx585_md *md, struct imx585_md_frame *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IMX585_MD_H */